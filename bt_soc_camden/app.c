@@ -44,6 +44,9 @@
 #include "sl_main_init.h"
 #include "app_assert.h"
 #include "app.h"
+#include "sl_core.h"
+#include <math.h>
+#include <string.h>
 
 #include "em_cmu.h"
 #include "em_prs.h"
@@ -51,7 +54,13 @@
 #include "em_gpio.h"
 #include "em_iadc.h"
 #include "em_letimer.h"
+#include "em_ldma.h"
+#include "em_timer.h"
 #include "sl_sleeptimer.h"
+#include "sl_power_manager.h"
+#include "sl_memory_manager.h"
+#include "sl_bluetooth_connection_config.h"
+#include "ble_ring.h"
 
 
 
@@ -61,61 +70,544 @@
 
 // IADC Configuration
 uint16_t iadcSAMPLESperPULSE = 12; // samples
-#define BLE_DATACHUNKSIZE      10;
+uint16_t iadc_samples_per_pulse_request = 12; // From GATT; planAcquisition() may run fewer for one measurement
+#define BLE_DATACHUNKSIZE      10
 uint16_t BLE_packetSize     = 120;
 // Note: Recording frequency can theoretically supports up to 1,919 Hz
+// (per-scan interrupt). Use IADC_TRANSFER_LDMA to drain the scan FIFO without waking the CPU per sample.
 // Set CLK_ADC to 40 MHz - this will be adjusted to HFXO frequency in the initialization process
 #define CLK_SRC_ADC_FREQ        40000000  // CLK_SRC_ADC - 40 MHz max
-#define CLK_ADC_FREQ             5000000  // CLK_ADC - 5 MHz max in High Accuracy mode
-#define ADC_TRIG_PRS_CHANNEL           0
+#define CLK_ADC_FREQ             5000000  // CLK_ADC - 5 MHz max in High Accuracy mode (10 MHz Normal/HighSpeed, see iadc_profiles)
+#define ADC_TRIG_PRS_CHANNEL           0  // LETIMER0 CH0 / TIMER1 CC0 -> IADC0 scan trigger (and jitter probe CC0)
+#define ADC_DONE_PRS_CHANNEL           1  // IADC0 scan table done -> jitter probe CC1
+#define VDAC_TRIG_PRS_CHANNEL          2  // LETIMER0 CH1 (underflow pulse) / TIMER1 overflow -> VDAC0 CH0 async trigger
 #define ADC_REF_VOLTAGE             2.42  // 1.21 V / 0.5 multiplier = 2.42 V reference
 //#define ADC_REF_VOLTAGE             1.8
 
+// IADC Transfer Mode
+#define IADC_TRANSFER_INTERRUPT        0  // IADC_IRQHandler pulls every scan from the FIFO
+#define IADC_TRANSFER_LDMA             1  // LDMA moves SCANFIFODATA into a ping-pong buffer, CPU wakes once per half
+#define IADC_LDMA_CHANNEL              0
+#define IADC_LDMA_WORDS_PER_SCAN       2  // One FIFO word per scan table entry (CH0, CH1)
+#define IADC_LDMA_SCANS_PER_HALF      12  // Scans per ping-pong half, i.e. samples handled per CPU wake-up
+#define IADC_LDMA_WORDS_PER_HALF      (IADC_LDMA_SCANS_PER_HALF * IADC_LDMA_WORDS_PER_SCAN)
+uint8_t iadc_transfer_mode = IADC_TRANSFER_INTERRUPT;
+
+// IADC Scan Trigger Source
+#define ADC_TRIGGER_SOFTWARE           0  // The timebase interrupt issues iadcCmdStartScan on its compare match
+#define ADC_TRIGGER_PRS                1  // LETIMER0 CH0 / TIMER1 CC0 output drives prsConsumerIADC0_SCANTRIGGER directly
+#define ADC_TRIGGER_SOURCE_MASK     0x01
+#define ADC_TRIGGER_JITTER_PROBE    0x80  // Also time-stamp every trigger edge and scan completion on TIMER0
+uint8_t adc_trigger_config = ADC_TRIGGER_SOFTWARE;
+uint8_t adc_trigger_source = ADC_TRIGGER_SOFTWARE; // Latched from adc_trigger_config at measurement start
+
+// Sample Timebase
+// Every sample slot is one period of the timebase. A compare match iadc_compare_ticks before the end
+// of the period starts the scan, the end of the period (LETIMER0 underflow, TIMER1 overflow) advances
+// the potential program. All periods are planned in ticks of timebase_hz.
+#define TIMEBASE_LETIMER               0  // LETIMER0 at 32.768 kHz, ~30.5 us steps, keeps running in EM2 (default)
+#define TIMEBASE_HFTIMER               1  // TIMER1 on EM01GRPACLK, sub-us steps, holds the device in EM1
+#define TIMEBASE_HF_TIMER         TIMER1
+#define LETIMER_CLOCK_HZ           32768
+uint8_t  timebase_request  = TIMEBASE_LETIMER;  // From GATT
+uint8_t  timebase_active   = TIMEBASE_LETIMER;  // Latched at measurement start
+uint32_t timebase_hz       = LETIMER_CLOCK_HZ;  // Tick rate of timebase_active
+bool     timebase_em1_held = false;
+
+// Trigger Jitter Probe
+// TIMER0 captures the LETIMER0 CH0 edge (CC0) and the IADC scan-done pulse (CC1) through PRS,
+// so the trigger-to-result latency is measured in HFPERCLK cycles without any ISR timing in it.
+#define JITTER_PROBE_TIMER        TIMER0
+bool     jitter_probe_active = false;
+uint32_t jitter_probe_count = 0;
+uint32_t jitter_probe_min_ticks = 0xFFFFFFFF;
+uint32_t jitter_probe_max_ticks = 0;
+uint64_t jitter_probe_sum_ticks = 0;
+uint32_t jitter_probe_edge_ticks = 0;     // Latest trigger edge not yet closed by a scan completion
+bool     jitter_probe_edge_valid = false;
+void initIADCScan(void);
+void jitterProbeStart(void);
+void jitterProbeStop(void);
+
+// IADC Accuracy/Speed Profiles
+// Ordered from fastest to most accurate so the planner can walk down the table until one fits.
+// Conversion time per scan = warm-up + scan entries * digAvg * cycles / CLK_ADC, where
+// cycles = 5*OSR + 7 (HighAccuracy) or 4*OSR + 2 (Normal, HighSpeed)
+#define IADC_SCAN_ENTRIES              2
+#define IADC_WARMUP_NS              5000  // iadcWarmupNormal after iadcClkSuspend0
+#define IADC_COMPARE_MARGIN_TICKS      1  // Extra timebase tick between end of conversion and the period end
+#define IADC_PROFILE_AUTO           0xFF  // Planner picks the highest OSR that fits the sample period
+#define IADC_PROFILE_DEFAULT           6  // HighAccuracy OSR 64x, the original fixed configuration
+
+typedef struct {
+    IADC_CfgAdcMode_t         adcMode;
+    IADC_CfgOsrHighSpeed_t    osrHighSpeed;    // Used by Normal and HighSpeed modes
+    IADC_CfgOsrHighAccuracy_t osrHighAccuracy; // Used by HighAccuracy mode
+    IADC_DigitalAveraging_t   digAvg;
+    uint16_t                  osr;             // Numeric OSR and averaging for the conversion time
+    uint8_t                   avg;
+    uint32_t                  clkAdcFreq;
+} iadc_profile_t;
+
+const iadc_profile_t iadc_profiles[] = {
+    { iadcCfgModeHighSpeed,    iadcCfgOsrHighSpeed2x,  iadcCfgOsrHighAccuracy16x,  iadcDigitalAverage1,    2,  1, 10000000 }, //  0:   1.0 us/ch
+    { iadcCfgModeHighSpeed,    iadcCfgOsrHighSpeed8x,  iadcCfgOsrHighAccuracy16x,  iadcDigitalAverage1,    8,  1, 10000000 }, //  1:   3.4 us/ch
+    { iadcCfgModeNormal,       iadcCfgOsrHighSpeed32x, iadcCfgOsrHighAccuracy16x,  iadcDigitalAverage1,   32,  1, 10000000 }, //  2:  13.0 us/ch
+    { iadcCfgModeNormal,       iadcCfgOsrHighSpeed64x, iadcCfgOsrHighAccuracy16x,  iadcDigitalAverage1,   64,  1, 10000000 }, //  3:  25.8 us/ch
+    { iadcCfgModeHighAccuracy, iadcCfgOsrHighSpeed2x,  iadcCfgOsrHighAccuracy16x,  iadcDigitalAverage1,   16,  1,  5000000 }, //  4:  17.4 us/ch
+    { iadcCfgModeHighAccuracy, iadcCfgOsrHighSpeed2x,  iadcCfgOsrHighAccuracy32x,  iadcDigitalAverage1,   32,  1,  5000000 }, //  5:  33.4 us/ch
+    { iadcCfgModeHighAccuracy, iadcCfgOsrHighSpeed2x,  iadcCfgOsrHighAccuracy64x,  iadcDigitalAverage1,   64,  1,  5000000 }, //  6:  65.4 us/ch
+    { iadcCfgModeHighAccuracy, iadcCfgOsrHighSpeed2x,  iadcCfgOsrHighAccuracy128x, iadcDigitalAverage1,  128,  1,  5000000 }, //  7: 129.4 us/ch
+    { iadcCfgModeHighAccuracy, iadcCfgOsrHighSpeed2x,  iadcCfgOsrHighAccuracy256x, iadcDigitalAverage1,  256,  1,  5000000 }, //  8: 257.4 us/ch
+    { iadcCfgModeHighAccuracy, iadcCfgOsrHighSpeed2x,  iadcCfgOsrHighAccuracy256x, iadcDigitalAverage4,  256,  4,  5000000 }, //  9: 1.03 ms/ch
+    { iadcCfgModeHighAccuracy, iadcCfgOsrHighSpeed2x,  iadcCfgOsrHighAccuracy256x, iadcDigitalAverage16, 256, 16,  5000000 }, // 10: 4.12 ms/ch
+};
+#define IADC_PROFILE_COUNT (sizeof(iadc_profiles) / sizeof(iadc_profiles[0]))
+
+uint8_t  iadc_profile_request = IADC_PROFILE_DEFAULT;  // From GATT: table index or IADC_PROFILE_AUTO (opt-in)
+uint8_t  iadc_active_profile  = IADC_PROFILE_DEFAULT;  // Profile the IADC is currently initialized with
+uint32_t iadc_compare_ticks   = 18;                    // Timebase compare lead before the period end
+bool     iadc_plan_clamped    = false;                 // Planner had to lower the sample rate
+uint32_t iadc_sample_lead_us  = 0;                     // From GATT: scan start before the period end, 0 = as late as the conversion allows
+
+// SWV Sampling Window
+// Only the late part of each half-period is converted, after the capacitive current has decayed.
+// The window opens at the later of "last N samples" and "X us after the potential step"; triggers
+// before it are not converted at all. iadcSAMPLE_count still counts every LETIMER sample slot.
+uint16_t sample_window_count    = 0;  // Keep the last N of iadcSAMPLESperPULSE samples, 0 = all
+uint32_t sample_window_delay_us = 0;  // Do not start a conversion earlier than this after the step
+uint16_t iadc_window_skip       = 0;  // Leading sample slots skipped per half-period (planned at start)
+uint16_t iadc_half_skip         = 0;  // Skip applied to the current half-period (window or electrode settling)
+bool     iadc_prs_armed         = false;
+
+// Multi-Electrode Round-Robin (SWV only)
+// The unit (one staircase step, or one half-period) is repeated on every electrode of electrode_mask
+// before the staircase moves on, so each electrode sees the full waveform in a single sweep.
+// The mux is switched from LETIMER0_IRQHandler at the half-period boundary and the first
+// electrode_settle_us of the following half-period are blanked out like the sampling window.
+#define ELECTRODE_COUNT                8
+#define ELECTRODE_SCAN_OFF             0  // electrode_channel for the whole experiment
+#define ELECTRODE_SCAN_PER_STEP        1  // Switch at every staircase step (reverse + forward half-period)
+#define ELECTRODE_SCAN_PER_PULSE       2  // Switch at every half-period
+uint8_t  electrode_scan_mode   = ELECTRODE_SCAN_OFF;
+uint8_t  electrode_mask        = 0;   // Bit n selects electrode n (C_A2..C_A0 = n)
+uint16_t electrode_settle_us   = 0;   // Blank-out after each mux switch
+bool     electrode_scan_active = false;
+uint8_t  electrode_list[ELECTRODE_COUNT];
+uint8_t  electrode_list_count  = 0;
+uint8_t  electrode_active      = 0;   // Electrode the mux currently selects
+uint16_t electrode_settle_skip = 0;   // Leading slots to skip after a mux or gain switch (planned at start)
+
+// Gain Autoranging (SWV only)
+// The TIA feedback resistor of each electrode is re-chosen from the ch0 codes of every half-period:
+// codes near either rail step the gain down, a swing that would still fit at the next higher gain
+// steps it up. Changes are applied only at step boundaries so both halves of a step share one gain.
+#define GAIN_COUNT                     4
+#define ADC_FULL_SCALE_CODE      0xFFFFF  // 20-bit right aligned
+#define AUTORANGE_CLIP_LOW_CODE   (ADC_FULL_SCALE_CODE / 32)       // ~3% of full scale
+#define AUTORANGE_CLIP_HIGH_CODE  (ADC_FULL_SCALE_CODE - ADC_FULL_SCALE_CODE / 32)
+#define AUTORANGE_FIT_LOW_CODE    (ADC_FULL_SCALE_CODE / 10)       // Upshift only if the swing stays in 10%..90%
+#define AUTORANGE_FIT_HIGH_CODE   (ADC_FULL_SCALE_CODE - ADC_FULL_SCALE_CODE / 10)
+#define AUTORANGE_BIAS_CODE       ((uint32_t)((double)SWV_REF_VOLTAGE / 1000.0 / ADC_REF_VOLTAGE * ADC_FULL_SCALE_CODE)) // TIA output at zero current
+#if RUN_MODE == 1
+// 0: 100k, 1: 200k, 2: 8.22k, 3: 20k
+const uint8_t  gain_order[GAIN_COUNT]        = { 2, 3, 0, 1 };              // gain_channel by increasing feedback resistance
+const uint32_t gain_resistor_ohms[GAIN_COUNT] = { 100000, 200000, 8220, 20000 };
+#else
+// 0: 20k, 1: 4.7k, 2: 12k, 3: 8.2k
+const uint8_t  gain_order[GAIN_COUNT]        = { 1, 3, 2, 0 };              // gain_channel by increasing feedback resistance
+const uint32_t gain_resistor_ohms[GAIN_COUNT] = { 20000, 4700, 12000, 8200 };
+#endif
+uint8_t  gain_autorange        = 0;   // From GATT: 0 = fixed gain_channel, 1 = autorange
+bool     gain_autorange_active = false;
+uint8_t  gain_active           = 3;   // gain_channel currently driven on F_A1/F_A0
+uint8_t  gain_rank[ELECTRODE_COUNT];          // Position in gain_order currently used by each electrode
+uint8_t  gain_rank_pending[ELECTRODE_COUNT];  // Position requested by the autoranger, applied at the next step
+uint32_t autorange_min_ch0 = ADC_FULL_SCALE_CODE;
+uint32_t autorange_max_ch0 = 0;
+void initIADC(void);
+
 // BLE Configuration
 static uint8_t advertising_set_handle = 0xff;
-static sl_status_t send_runExperiment_notification();
+static sl_status_t send_runExperiment_notification(uint8_t value);
 // static sl_status_t send_result_notification();
-volatile bool BLE_notify_runExperiment = false;
-volatile bool BLE_notify_result = false;
 volatile bool BLE_transmission_busy = false;
 volatile bool measurement_complete = false;
-uint8_t  BLE_value_runExperiment = 0;
+uint8_t  BLE_value_runExperiment = 0;  // 0 = idle, 2 = pre-phase, 1 = scan
+
+// Run Experiment notifications wait until the packets queued before them are sent, so the host
+// switches between the pre-phase and scan record formats at the right packet, also when the link
+// lags or the capture is uploaded after the scan
+#define RUN_STATE_QUEUE_SIZE 4
+typedef struct {
+    uint8_t  value;
+    uint32_t after;  // BLE_queue.head when the state changed
+} run_state_t;
+run_state_t run_state_queue[RUN_STATE_QUEUE_SIZE];
+uint8_t     run_state_count = 0;
 
 // BLE Packet Queue Configuration
-#define BLE_QUEUE_SIZE 8  // Number of packets that can be queued
-#define BLE_MAX_PACKET_SIZE 200  // Maximum size of each packet
+#ifndef BLE_QUEUE_SIZE
+#define BLE_QUEUE_SIZE 8  // Number of packets that can be queued, a power of two
+#endif
+#if (BLE_QUEUE_SIZE & (BLE_QUEUE_SIZE - 1)) != 0
+#error "BLE_QUEUE_SIZE must be a power of two"
+#endif
 
-typedef struct {
-    uint8_t data[BLE_MAX_PACKET_SIZE];
-    uint8_t size;  // Actual packet size
-} ble_packet_t;
-
-// Circular queue for BLE packets
-ble_packet_t BLE_packet_queue[BLE_QUEUE_SIZE];
-volatile uint8_t BLE_queue_head = 0;     // Points to next position to write
-volatile uint8_t BLE_queue_tail = 0;     // Points to next position to read
-volatile uint8_t BLE_queue_count = 0;    // Number of packets in queue
-
-// Current packet being built
-uint8_t  BLE_current_packet[BLE_MAX_PACKET_SIZE];
+// Single-producer single-consumer ring for BLE packets, see ble_ring.h
+// The acquisition interrupt is the only writer of the head, apart from app_process_action packing
+// with that interrupt masked, and app_process_action is the only writer of the tail. Under
+// CAPTURE_POLICY_DROP_OLDEST the interrupt posts the overwritten packets for app_process_action to skip.
+// The ring starts on the static slots and moves to the capture buffer once that is allocated at boot.
+ble_packet_t BLE_packet_queue_static[BLE_QUEUE_SIZE];
+ble_ring_t   BLE_queue = { BLE_packet_queue_static, BLE_QUEUE_SIZE, 0, 0, 0, (uint32_t)-1 };
+
+// Current packet being built, packed in place in the reserved queue slot
+// While the queue is full the records land in BLE_discard_packet and that packet is dropped
+uint8_t  BLE_discard_packet[BLE_MAX_PACKET_SIZE];
+uint8_t *BLE_current_packet = BLE_discard_packet;
 uint8_t  BLE_result_counter = 0; // Track current position in result buffer
-uint32_t BLE_dropped_packets = 0; // Track dropped packets for debugging (should be 0 now)
+uint32_t BLE_dropped_packets = 0; // Lost to a full queue or given up after BLE_SEND_MAX_ATTEMPTS, sent in Link Stats
+uint32_t BLE_retried_packets = 0; // Notifications the stack refused and that stayed at the head of the queue
+uint8_t  BLE_head_attempts   = 0; // Failed attempts on the packet at the head of the queue
+#define BLE_SEND_MAX_ATTEMPTS 16  // Drop the head packet after this many failures other than full stack buffers
+
+// Capture Buffer
+// Whole-experiment buffering in the heap the Bluetooth stack leaves free after boot, so a stalled link
+// does not cost data. The policy decides when packets are sent and what happens once the buffer is full.
+#define CAPTURE_POLICY_STREAM        0  // Send live, buffer while the link lags, drop new packets when full
+#define CAPTURE_POLICY_UPLOAD        1  // Hold the whole measurement and send it after the scan stops
+#define CAPTURE_POLICY_DROP_OLDEST   2  // Send live, overwrite the oldest unsent packet when full
+#define CAPTURE_HEAP_RESERVE     16384  // Heap kept free for the stack's per-connection allocations
+uint8_t  capture_policy = CAPTURE_POLICY_STREAM;
+uint32_t BLE_overwritten_packets = 0; // Oldest packets given up under CAPTURE_POLICY_DROP_OLDEST
+
+// BLE Link Sizing
+// A notification of N bytes takes N + BLE_NOTIFY_OVERHEAD octets on the link. Packets are sized to the
+// largest N within ATT_MTU - 3 that fills whole link-layer PDUs of the negotiated TX data length,
+// from the values reported after connection_opened asked for the 2M PHY and the longest PDUs.
+#define BLE_ATT_MTU_MAX              250  // Largest ATT_MTU the stack accepts
+#define BLE_ATT_MTU_DEFAULT           23
+#define BLE_LL_DATA_LEN_DEFAULT       27
+#define BLE_LL_TX_TIME_US           2120  // SL_BT_CONFIG_CONNECTION_DATA_LENGTH octets on the 1M PHY
+#define BLE_NOTIFY_OVERHEAD            7  // ATT opcode and handle, L2CAP length and channel
+uint16_t BLE_att_mtu      = BLE_ATT_MTU_DEFAULT;
+uint16_t BLE_ll_data_len  = BLE_LL_DATA_LEN_DEFAULT;
+uint16_t BLE_link_payload = BLE_ATT_MTU_DEFAULT - 3; // Notification size for the current link
+
+// Recompute BLE_link_payload after the MTU or data length changed; applies from the next measurement
+static void BLE_linkPayloadUpdate(void)
+{
+  uint16_t payload = BLE_att_mtu - 3;
+  uint16_t pdus    = (payload + BLE_NOTIFY_OVERHEAD) / BLE_ll_data_len;
+  if (pdus > 0) {
+    payload = pdus * BLE_ll_data_len - BLE_NOTIFY_OVERHEAD;
+  }
+  BLE_link_payload = (payload > BLE_MAX_PACKET_SIZE) ? BLE_MAX_PACKET_SIZE : payload;
+}
+
+// Packet size holding as many whole records of record_size as the link payload allows
+static uint16_t BLE_packetSizeFor(uint8_t record_size)
+{
+  uint16_t size = (BLE_link_payload / record_size) * record_size;
+  return (size > 0) ? size : record_size;
+}
+
+// Raw SWV packets hold one pulse of samples, unless that does not fit the link
+static uint16_t BLE_pulsePacketSize(void)
+{
+  uint32_t size = (uint32_t)iadcSAMPLESperPULSE * BLE_DATACHUNKSIZE;
+  return (size > BLE_link_payload) ? BLE_packetSizeFor(BLE_DATACHUNKSIZE) : (uint16_t)size;
+}
+
+// Streaming Mode
+// Raw streams every scan as a BLE_DATACHUNKSIZE record. Decimated (SWV, NPV, RPV) accumulates the samples
+// of each half-period on the device and streams one BLE_DECIMATED_CHUNKSIZE record per half-period:
+//   ch0 mean (3B), ch0 min (3B), ch0 max (3B), ch1 mean (3B), vdac (2B), half-period index (2B),
+//   sample count (1B), flags (1B: electrode in bits 7:4, gain in bits 3:0)
+#define STREAM_MODE_RAW                0
+#define STREAM_MODE_DECIMATED          1
+#define STREAM_MODE_SWV_DIFF           2
+#define BLE_DECIMATED_CHUNKSIZE       18
+// Difference mode (SWV, DPV) pairs the reverse half-period (even vdacOUT_count, offset - height) with the
+// forward half-period that follows it on the same vdacOUT_offset and streams one record per staircase step:
+//   step potential (2B), I_fwd ch0 mean (3B), I_rev ch0 mean (3B), delta I = fwd - rev (3B, signed),
+//   step index (2B), flags (1B)
+#define BLE_SWV_DIFF_CHUNKSIZE        14
+// Impedance mode (mode 8 only, not selectable through Stream Mode) streams one record per frequency:
+//   frequency in mHz (4B), |Z| in ohms (4B, float32), phase of Z in 0.01 deg (2B, signed),
+//   ch0 amplitude in ADC codes (3B), frequency index (1B), flags (1B: gain in bits 3:0)
+#define STREAM_MODE_EIS                3
+#define BLE_EIS_CHUNKSIZE             15
+uint8_t stream_mode = STREAM_MODE_RAW;         // From GATT
+uint8_t stream_active_mode = STREAM_MODE_RAW;  // Latched at measurement start, raw for non-SWV modes
+
+// Per half-period accumulator (STREAM_MODE_DECIMATED, STREAM_MODE_SWV_DIFF)
+uint64_t pulse_sum_ch0 = 0;
+uint64_t pulse_sum_ch1 = 0;
+uint32_t pulse_min_ch0 = 0xFFFFF;
+uint32_t pulse_max_ch0 = 0;
+
+// Reverse half-period waiting for its forward partner, per electrode (STREAM_MODE_SWV_DIFF)
+bool     swv_reverse_valid[ELECTRODE_COUNT];
+uint32_t swv_reverse_mean[ELECTRODE_COUNT];
+uint16_t swv_reverse_vdac[ELECTRODE_COUNT];
+static void BLE_reserve_packet(void);
+static void runStateNotify(uint8_t value);
+static void BLE_report_link_stats(void);
+static void eisProcessResults(void);
+static void BLE_flush_packet(uint8_t size);
+static void pulseAccumulatorReset(void);
+
+// LDMA ping-pong buffer for IADC scan results (IADC_TRANSFER_LDMA only)
+// The LETIMER records the VDAC value and sample count of every scan it triggers so that the
+// LDMA half-buffer handler can tag each result after the fact.
+typedef struct {
+    uint16_t vdac_value;
+    uint32_t sample_count; // Full count so half-period bookkeeping survives the 16-bit record field wrapping
+    uint32_t half_period;  // vdacOUT_count while the scan was taken
+    uint8_t  electrode;    // Electrode selected by the mux while the scan was taken
+    uint8_t  gain;         // gain_channel driven while the scan was taken
+    uint8_t  cycle;        // Cycle of the potential program the scan belongs to
+    uint8_t  phase;        // Sine position of the potential program (impedance mode)
+} iadc_sample_tag_t;
+
+uint32_t iadc_ldma_buffer[2][IADC_LDMA_WORDS_PER_HALF];
+iadc_sample_tag_t iadc_ldma_tags[2 * IADC_LDMA_SCANS_PER_HALF];
+volatile uint8_t iadc_ldma_tag_index = 0; // Next tag slot, advanced once per triggered scan
+volatile uint8_t iadc_ldma_half = 0;      // Half of the ping-pong buffer currently being filled
+bool iadc_ldma_running = false;
+LDMA_Descriptor_t iadc_ldma_descriptors[2];
+void iadcLdmaStart(void);
+void iadcLdmaStop(void);
+
+// Potential Program
+// Every operating mode is described as a list of waveform segments (holds, steps, ramps, pulses
+// and repeats of the preceding segments). waveformCompile() turns the list into waveform_ops[]
+// once at measurement start; waveformTick() then runs one op per stretch of LETIMER periods,
+// so the per-tick work is a countdown and one Q16.16 add whatever the technique.
+// waveformTick() is pure bookkeeping: the caller applies the mux, gain and VDAC side effects,
+// so the same program can be run live in LETIMER0_IRQHandler or ahead of time into the VDAC
+// playback ring.
+#define WAVEFORM_EVENT_BOUNDARY        0x01  // Half-period boundary (re-plans the sampling window)
+#define WAVEFORM_EVENT_ELECTRODE       0x02  // Round-robin moves on to the next electrode
+#define WAVEFORM_EVENT_STEP_START      0x04  // First half-period of a staircase step (gain switch point)
+#define WAVEFORM_EVENT_HALF            0x08  // New half-period, counted in vdacOUT_count
+#define WAVEFORM_EVENT_CYCLE           0x10  // New cycle, counted in the cycle index of the records
+#define WAVEFORM_EVENT_NO_SAMPLE       0x20  // With BOUNDARY: no scans at all in this half-period
+#define WAVEFORM_EVENT_OPEN_CIRCUIT    0x40  // With BOUNDARY: VDAC output disconnected in this segment (pre-phase only)
+#define WAVEFORM_EVENT_FINISHED        0x80  // Program ran out, the potential holds from here on
+#define WAVEFORM_SEGMENT_MARKS         0x3F  // Events a segment may raise at its first tick
+
+// Segment kinds, 8 bytes each on the wire: kind, marks, value (int16), ticks (uint32), little endian
+#define WAVEFORM_SEG_HOLD              1  // Base level := value, output it for ticks
+#define WAVEFORM_SEG_STEP              2  // Base level += value, output it for ticks
+#define WAVEFORM_SEG_RAMP              3  // Ramp base level by value over ticks, ends exactly on base + value
+#define WAVEFORM_SEG_PULSE             4  // Output base + value for ticks, base level unchanged
+#define WAVEFORM_SEG_REPEAT            5  // Run the previous value segments ticks times in total (0 = forever)
+#define WAVEFORM_SEG_LEVEL             6  // Output value for ticks, base level unchanged
+#define WAVEFORM_SEG_SINE              7  // Output base + value * sine for ticks, WAVEFORM_SINE_STEPS ticks per period
+#define WAVEFORM_SEGMENT_SIZE          8
+#define WAVEFORM_MAX_SEGMENTS         30  // 240 byte Waveform Program characteristic
+#define WAVEFORM_MAX_OPS              64
+#define WAVEFORM_LOOP_DEPTH            4
+
+// One sine period in Q15, sampled at the start of every tick
+#define WAVEFORM_SINE_STEPS           32
+const int16_t waveform_sine_q15[WAVEFORM_SINE_STEPS] = {
+         0,   6393,  12539,  18204,  23170,  27245,  30273,  32137,
+     32767,  32137,  30273,  27245,  23170,  18204,  12539,   6393,
+         0,  -6393, -12539, -18204, -23170, -27245, -30273, -32137,
+    -32767, -32137, -30273, -27245, -23170, -18204, -12539,  -6393,
+};
+
+// Compile status in the Waveform Status characteristic
+#define WAVEFORM_OK                    0
+#define WAVEFORM_ERR_KIND              1  // Unknown segment kind
+#define WAVEFORM_ERR_REPEAT            2  // Repeat body reaches outside the program or into another body
+#define WAVEFORM_ERR_EMPTY_LOOP        3  // Endless repeat of segments that take no time
+#define WAVEFORM_ERR_DEPTH             4  // Repeats nested deeper than WAVEFORM_LOOP_DEPTH
+#define WAVEFORM_ERR_SIZE              5  // Does not fit in WAVEFORM_MAX_OPS
+#define WAVEFORM_ERR_AMPLITUDE         6  // Sine amplitude beyond WAVEFORM_SINE_AMP_MAX
+
+#define WAVEFORM_SINE_AMP_MAX       4095  // VDAC full scale, keeps the Q16 sine sum inside int32
+
+typedef struct {
+    uint8_t  kind;
+    uint8_t  marks;
+    int16_t  value;
+    uint32_t ticks;
+} waveform_segment_t;
+
+#define WAVEFORM_OP_RUN                0
+#define WAVEFORM_OP_LOOP               1
+#define WAVEFORM_OP_END                2
+typedef struct {
+    uint8_t  opcode;
+    uint8_t  events;          // Raised when the op is entered
+    bool     absolute;        // RUN: base_q16 replaces the base level instead of adding to it
+    bool     fixed;           // RUN: offset_q16 is the output itself, not relative to the base level
+    uint8_t  body;            // LOOP: ops to jump back
+    int32_t  base_q16;        // RUN: base level change
+    int32_t  offset_q16;      // RUN: output at the first tick relative to the base level
+    int32_t  slope_q16;       // RUN: added to the output at every following tick
+    int16_t  sine_amp;        // RUN: amplitude of the waveform_sine_q15 period added on top
+    uint32_t ticks;           // RUN: LETIMER periods; LOOP: iterations (0 = forever)
+} waveform_op_t;
+
+waveform_segment_t waveform_segments[WAVEFORM_MAX_SEGMENTS];
+uint8_t            waveform_segment_count = 0;
+uint8_t            waveform_program[WAVEFORM_MAX_SEGMENTS * WAVEFORM_SEGMENT_SIZE]; // Uploaded, operating_mode 3
+uint8_t            waveform_program_len = 0;
+waveform_op_t      waveform_ops[WAVEFORM_MAX_OPS];
+uint8_t            waveform_op_count = 0;
+uint8_t            waveform_status = WAVEFORM_OK;
+bool               waveform_cycle_tagged = false; // Compiled program announces cycles, raw records carry the index
+
+typedef struct {
+    uint8_t  pc;              // Next op to enter
+    uint32_t ticks_left;      // Periods left in the current op after this one
+    int32_t  base_q16;        // Base level in Q16.16 VDAC units
+    int32_t  out_q16;         // Output level in Q16.16 VDAC units
+    int32_t  slope_q16;
+    int32_t  sine_amp;
+    uint8_t  phase;           // Position in waveform_sine_q15 of the current tick
+    uint8_t  loop_depth;
+    uint8_t  loop_pc[WAVEFORM_LOOP_DEPTH];
+    uint32_t loop_left[WAVEFORM_LOOP_DEPTH];
+    uint32_t half_period;     // vdacOUT_count
+    uint16_t cycle;           // Cycles started after the first one
+    uint16_t value;           // vdacOUT_value
+    uint8_t  electrode_index; // Position in electrode_list
+    bool     finished;
+} waveform_state_t;
+
+waveform_state_t waveform_live;  // Program as LETIMER0_IRQHandler runs it (tags, mux, gain)
+waveform_state_t waveform_ahead; // Same program, running ahead to fill the VDAC playback ring
+
+// VDAC Playback
+// VDAC_PLAYBACK_LDMA moves the precomputed potential program from a RAM ring into VDAC0 CH0F,
+// and LETIMER0 CH1 triggers the conversion through PRS at every underflow. The potential then
+// changes on the timer edge itself instead of whenever LETIMER0_IRQHandler gets to run; the CPU
+// only refills one half of the ring every VDAC_LDMA_WORDS_PER_HALF periods.
+#define VDAC_PLAYBACK_CPU              0  // LETIMER0_IRQHandler writes the VDAC
+#define VDAC_PLAYBACK_LDMA             1  // LDMA feeds the VDAC FIFO, LETIMER0 CH1 triggers each conversion
+#define VDAC_LDMA_CHANNEL              1
+#define VDAC_LDMA_WORDS_PER_HALF      32  // LETIMER periods per ping-pong half
+uint8_t vdac_playback        = VDAC_PLAYBACK_CPU;
+uint8_t vdac_playback_active = VDAC_PLAYBACK_CPU; // Latched from vdac_playback at measurement start
+uint32_t vdac_ldma_buffer[2][VDAC_LDMA_WORDS_PER_HALF];
+uint32_t vdac_ref_ldma_buffer[2][VDAC_LDMA_WORDS_PER_HALF]; // Complement for VDAC1 (VDAC_DRIVE_BIPOLAR)
+volatile uint8_t vdac_ldma_half = 0;   // Half of the ring currently being played
+LDMA_Descriptor_t vdac_ldma_descriptors[2];
+LDMA_Descriptor_t vdac_ref_ldma_descriptors[2];
+VDAC_InitChannel_TypeDef vdac_sig_channel_config;
+bool vdac_sig_connected = true;        // False while an open circuit segment floats the output
+void vdacSignalTrigModeSet(VDAC_TrigMode_TypeDef trigMode);
+void vdacSignalConnect(bool connect);
+void vdacPlaybackStart(void);
+void vdacPlaybackStop(void);
+
 uint8_t  gain_channel = 3; // Default to channel 3 (F_A1=1, F_A0=1)
 uint8_t  electrode_channel = 4; // Default to channel 4 (C_A2=1, C_A1=0, C_A0=0)
-uint16_t time_before_trial = 5; // Default 5 seconds before trial starts (in s)
+uint16_t time_before_trial = 5; // Default 5 seconds before trial starts (in s), held when no pre-phase steps are set
 uint16_t time_after_trial = 5;  // Default 5 seconds after trial ends (in s)
-uint8_t  operating_mode = 0;    // Default to 0 (Square Wave Voltammetry), 1 = Linear Sweep, 2 = Pulse Mode
+uint8_t  operating_mode = 0;    // Default to 0 (Square Wave Voltammetry), 1 = Linear Sweep, 2 = Pulse Mode, 3 = Uploaded Program, 4 = DPV, 5 = NPV, 6 = RPV, 7 = Chronoamperometry, 8 = Impedance
 uint16_t linear_sweep_rate = 100; // Default linear sweep rate in mV/s
 uint16_t linear_sweep_sample_rate = 25; // Default sampling rate for linear sweep in Hz
-int16_t  linear_sweep_step = 0;   // Pre-calculated linear sweep step (in VDAC units per sample)
+uint16_t linear_sweep_sample_rate_request = 25; // From GATT; planAcquisition() may lower it for one measurement
+int16_t  linear_sweep_step = 0;   // Direction of the linear sweep (+1 / -1 VDAC unit, 0 = flat)
+int32_t  linear_sweep_step_q16 = 0;     // Pre-calculated linear sweep step in Q16.16 VDAC units per tick (signed)
+// Cyclic voltammetry: start -> vertices -> start, repeated back to back without time_before_trial.
+// Raw records of a multi-cycle program carry the cycle index (modulo 16) in the otherwise unused top
+// nibble of the VDAC field; single-cycle programs leave the field a plain 12-bit VDAC code.
+#define LINEAR_SWEEP_MAX_VERTICES 4
+uint16_t linear_sweep_cycles = 1;       // Cycles per measurement, 0 = until stopped
+uint16_t linear_sweep_vertices[LINEAR_SWEEP_MAX_VERTICES]; // Turning potentials in VDAC units
+uint8_t  linear_sweep_vertex_count = 0; // 0 = a single vertex at vdacOUT_stop
 
 // Pulse mode variables
 uint8_t  time_before_pulse = 1; // Default 1 second before pulse (in s)
 uint8_t  time_after_pulse = 1;  // Default 1 second after pulse (in s)
 uint16_t pulse_width_ms = 100;  // Default pulse width in milliseconds
 uint16_t pulse_height = 40;     // Default pulse height in VDAC units (separate from vdacOUT_pulse for SWV)
-uint32_t pulse_timer_count = 0; // Timer count for pulse mode timing
-uint8_t  pulse_state = 0;       // 0=before_pulse, 1=pulse_active, 2=after_pulse, 3=complete
+
+// Pulse train modes (4 = DPV, 5 = NPV, 6 = RPV)
+// One pulse of pulse_width_ms every pulse_period_ms. The period is run as whole pulse widths: only
+// the pulse and, for DPV, the width right before it are sampled, the rest is not converted at all.
+// DPV steps the base by vdacOUT_step and pulses the last width of each period by PULSE_HEIGHT in the
+// direction of the scan (-vdacOUT_pulse, like the forward half of SWV).
+// NPV holds the base at vdacOUT_start and pulses to start + k * vdacOUT_step up to vdacOUT_stop.
+// RPV holds the base at vdacOUT_stop and pulses back to stop - k * vdacOUT_step down to vdacOUT_start.
+uint16_t pulse_period_ms = 200; // Default pulse period in milliseconds (rounded to whole pulse widths, at least two)
+
+// Chronoamperometry (mode 7)
+// Holds each potential of chrono_steps for its duration. Right after every step the LETIMER runs at
+// chrono_fast_rate; every CHRONO_SAMPLES_PER_OCTAVE samples its period doubles until it reaches
+// 1 / linear_sweep_sample_rate, so the samples are log-spaced after each step. The LETIMER top is
+// reprogrammed at every underflow; the host rebuilds the sample times from the same schedule.
+#define CHRONO_MAX_STEPS               8
+#define CHRONO_SAMPLES_PER_OCTAVE      8
+typedef struct {
+    uint16_t potential;        // VDAC units
+    uint16_t duration_ms;      // Rounded up to whole sample periods
+} chrono_step_t;
+chrono_step_t chrono_steps[CHRONO_MAX_STEPS];
+uint8_t  chrono_step_count = 0;
+uint16_t chrono_fast_rate  = 1000; // Default sample rate right after each step in Hz
+uint16_t chrono_fast_rate_request = 1000; // From GATT; planAcquisition() may lower it for one measurement
+uint32_t chrono_fast_ticks = 0;    // LETIMER periods, planned at measurement start
+uint32_t chrono_slow_ticks = 0;
+uint32_t chrono_index      = 0;    // Sample period within its step that the LETIMER loads next
+bool     chrono_active     = false;
+
+// Pre-phase (all modes)
+// Runs ahead of the scan in the same timebase and waveform engine, at prephase_rate, and streams one
+// decimated record per iadcSAMPLESperPULSE samples. Each step holds its potential (conditioning,
+// deposition, quiet time) or, at PREPHASE_OPEN_CIRCUIT, disconnects the VDAC so the records follow the
+// open circuit potential. Steps last a whole number of records. Without steps vdacOUT_start is held for
+// time_before_trial without sampling, as the fixed delay used to do. The scan starts right after.
+#define PREPHASE_MAX_STEPS             4
+#define PREPHASE_OPEN_CIRCUIT     0xFFFF
+typedef struct {
+    uint16_t potential;        // VDAC units or PREPHASE_OPEN_CIRCUIT
+    uint16_t duration_ds;      // In 0.1 s
+} prephase_step_t;
+prephase_step_t prephase_steps[PREPHASE_MAX_STEPS];
+uint8_t  prephase_step_count   = 0;
+uint16_t prephase_rate         = 10;    // Default pre-phase sample rate in Hz
+uint32_t prephase_period_ticks = 0;     // Timebase period of the pre-phase, planned at measurement start
+volatile bool prephase_running = false; // The pre-phase is playing, the scan starts once it finishes
+
+// Impedance Spectroscopy (mode 8)
+// vdacOUT_start biases the cell and a sine of eis_amplitude is played on top of it, one frequency of
+// eis_frequencies after the other. Every tick is sampled, so the IADC runs synchronously at
+// WAVEFORM_SINE_STEPS times the frequency. After EIS_SETTLE_PERIODS the ch0 samples are correlated
+// with the sine and cosine over eis_periods whole periods, and only |Z| and phase are streamed.
+// The interrupt only keeps the integer sums of each frequency; app_process_action turns them into
+// |Z| and phase in floating point and packs the records.
+#define EIS_MAX_FREQUENCIES           16
+#define EIS_SETTLE_PERIODS             1
+#define EIS_TIA_INVERTING              1  // TIA output falls as the cell current rises
+#define EIS_PI                3.14159265f
+uint16_t eis_frequencies[EIS_MAX_FREQUENCIES]; // In 0.1 Hz
+uint8_t  eis_frequency_count = 0;
+uint16_t eis_amplitude       = 8;  // Default sine amplitude in VDAC units
+uint8_t  eis_periods         = 4;  // Default number of periods correlated per frequency
+uint32_t eis_point_ticks[EIS_MAX_FREQUENCIES]; // Timebase period per sample, planned at measurement start
+uint8_t  eis_point           = 0;  // Frequency the timebase loads next
+bool     eis_active          = false;
+// Lock-in sums of the frequency being sampled
+int64_t  eis_acc_i           = 0;  // ch0 * sin
+int64_t  eis_acc_q           = 0;  // ch0 * cos
+uint32_t eis_acc_count       = 0;
+uint32_t eis_acc_point       = 0;  // half_period tag of the frequency being summed
+// Finished sums per frequency, handed from the interrupt to app_process_action in frequency order
+int64_t  eis_result_i[EIS_MAX_FREQUENCIES];
+int64_t  eis_result_q[EIS_MAX_FREQUENCIES];
+uint8_t  eis_result_gain[EIS_MAX_FREQUENCIES];
+volatile uint8_t eis_results_done   = 0; // Frequencies summed by the interrupt
+uint8_t          eis_results_packed = 0; // Frequencies packed by app_process_action
 // Pre-calculated timing values (calculated once, used in interrupt)
 uint32_t pulse_before_ticks = 0;    // Pre-calculated ticks for before pulse phase
 uint32_t pulse_width_ticks = 0;     // Pre-calculated ticks for pulse width
@@ -127,10 +619,12 @@ int16_t vdacOUT_offset_volts    = -11; // in mV ##V1 device is -11, -18 for osco
 #if RUN_MODE == 0
   #define VDAC_REF_SELECT vdacRef2V5
   #define VDAC_REF_VOLTAGE 2.5
+  #define VDAC_REF_MV      2500
 
 #elif (RUN_MODE == 1) | (RUN_MODE == 2)
   #define VDAC_REF_SELECT vdacRefAvdd
   #define VDAC_REF_VOLTAGE 1.8
+  #define VDAC_REF_MV      1800
 
 #endif
 
@@ -155,15 +649,31 @@ uint32_t samples_in_current_pulse = 0;
 // Linear sweep mode variables
 uint32_t linear_sweep_timer_count = 0;
 uint16_t linear_sweep_current_voltage = 0;
-bool linear_sweep_direction_forward = true; // true = start->stop, false = stop->start
 
 /*
  * Operating Mode Implementation:
  * Mode 0 (Square Wave Voltammetry): Uses the original pulse-based voltage changes
  * Mode 1 (Linear Sweep): Continuously sweeps voltage at linear_sweep_rate (mV/s)
- *         from start to stop voltage, taking measurements at each timer tick
+ *         from start to stop voltage, taking measurements at each timer tick; with
+ *         Linear Sweep Cycles / Vertices it becomes multi-cycle cyclic voltammetry
  * Mode 2 (Pulse Mode): Sets voltage to START for TIME_BEFORE_PULSE, then increases
  *         by PULSE_HEIGHT for PULSE_WIDTH, then sets to STOP for TIME_AFTER_PULSE
+ * Mode 3 (Uploaded Program): Runs the segments written to the Waveform Program
+ *         characteristic, one LETIMER period every 1 / linear_sweep_sample_rate
+ * Mode 4 (Differential Pulse Voltammetry): Steps the base by VOLTAGE_STEP every PULSE_PERIOD
+ *         and pulses it by PULSE_HEIGHT for the last PULSE_WIDTH; streams difference records
+ * Mode 5 (Normal Pulse Voltammetry): Rests at START and pulses for PULSE_WIDTH every PULSE_PERIOD,
+ *         one VOLTAGE_STEP further each time up to STOP; streams one decimated record per pulse
+ * Mode 6 (Reverse Pulse Voltammetry): As mode 5 with the rest at STOP and the pulses stepping back
+ *         towards START
+ * Mode 7 (Chronoamperometry): Holds each potential of CHRONO_STEPS for its duration, sampling at
+ *         CHRONO_FAST_RATE right after every step and log-spaced down to LINEAR_SWEEP_SAMPLE_RATE
+ * Mode 8 (Impedance): Plays an EIS_AMPLITUDE sine around START at each of EIS_FREQUENCIES and
+ *         streams |Z| and phase from an on-device lock-in over EIS_PERIODS periods
+ * All modes are compiled by waveformPlan() into the same op list for the timebase interrupt; the
+ * timebase is LETIMER0 by default or TIMER1 (TIMEBASE characteristic) for fast or exact periods.
+ * Every mode is preceded by the PRE-PHASE steps (or a TIME_BEFORE_TRIAL hold); RUN_EXPERIMENT reads
+ * 2 while they run and 1 once the scan itself started.
  */
 
 
@@ -235,11 +745,11 @@ bool linear_sweep_direction_forward = true; // true = start->stop, false = stop-
 #define VDAC_SIG_PORT vdacChPortA
 #define VDAC_SIG_PIN            3
 #define VDAC_SIG_BUS  GPIO_ABUSALLOC_AODD0_VDAC0CH0 // IMPORTANT Don't forget to change GPIO Register too
-//#define VDAC_REF_ID         VDAC1 // Reference
-//#define VDAC_REF_CH             0
-//#define VDAC_REF_PORT vdacChPortC
-//#define VDAC_REF_PIN            1
-//#define VDAC_REF_BUS  GPIO_CDBUSALLOC_CDODD0_VDAC1CH0 // IMPORTANT Don't forget to change GPIO Register too
+#define VDAC_REF_ID         VDAC1 // Reference (VDAC_DRIVE_BIPOLAR only)
+#define VDAC_REF_CH             0
+#define VDAC_REF_PORT vdacChPortC
+#define VDAC_REF_PIN            1
+#define VDAC_REF_BUS  GPIO_CDBUSALLOC_CDODD0_VDAC1CH0 // IMPORTANT Don't forget to change GPIO Register too
 //// USING PA03 Bricks the firmware, possibly liked to DBG traces. Test PA05 instead
 //// ALSO PC01 is not routed out on the dev kit.  Test PC05 instead
 
@@ -261,6 +771,25 @@ bool linear_sweep_direction_forward = true; // true = start->stop, false = stop-
 
 #endif
 
+// VDAC Drive
+// Single: VDAC0 drives the working electrode against the fixed cell reference, the cell sees
+// code - vdacOUT_ref. Bipolar: VDAC1 drives the reference electrode with the complement of the same
+// code, so the cell sees 2 * code - 4095 counts, twice the window of one DAC in steps of two counts.
+// Both DACs convert on the same timebase edge when VDAC_PLAYBACK_LDMA feeds them.
+#define VDAC_DRIVE_SINGLE              0
+#define VDAC_DRIVE_BIPOLAR             1
+#define VDAC_REF_LDMA_CHANNEL          2
+uint8_t vdac_drive = VDAC_DRIVE_SINGLE;   // From GATT, only changed between measurements
+VDAC_InitChannel_TypeDef vdac_ref_channel_config;
+
+// Write one potential code to the cell
+static inline void vdacOutputSet(uint16_t value) {
+  VDAC_ChannelOutputSet(VDAC_SIG_ID, VDAC_SIG_CH, value);
+  if (vdac_drive == VDAC_DRIVE_BIPOLAR) {
+    VDAC_ChannelOutputSet(VDAC_REF_ID, VDAC_REF_CH, 4095 - value);
+  }
+}
+
 
 // Initialization Values Only
 #define INITIAL_VOLTAGE_START   900  // mV
@@ -290,33 +819,49 @@ uint16_t vdacOUT_stop   = ((int) ((double) INITIAL_VOLTAGE_STOP    * 4.096 / (do
 //     VDAC_ChannelOutputSet(vdac, channel, (uint16_t)calibrated_value);
 // }
 
+// Timebase ticks per period of a rate in Hz, rounded
+static inline uint32_t timebaseRateTicks(uint16_t rate_hz) {
+    return (rate_hz > 0) ? (timebase_hz + rate_hz / 2) / rate_hz : timebase_hz;
+}
+
 // Function to calculate linear sweep step
+// The sweep is a Q16.16 phase accumulator advanced once per LETIMER tick, so any mV/s rate is
+// reproduced at any sample rate, including steps well below one VDAC count per tick.
+// The tick rate is the one the timebase really runs at: timebase_hz / period, period = timebaseRateTicks(sample_rate).
+//   step_q16 = rate [mV/s] * 4096 / VDAC_REF_MV [counts/mV] * 65536 / (timebase_hz / period) [ticks/s]
+//            = rate * 2^28 * period / (VDAC_REF_MV * timebase_hz)
 void calculateLinearSweepStep(void) {
     if (operating_mode == 1 && linear_sweep_sample_rate > 0) {
-        // Calculate step in VDAC units per sample
-        // linear_sweep_rate (mV/s) * (4.096 / VDAC_REF_VOLTAGE) / linear_sweep_sample_rate (Hz)
-        double step_per_sample = (double)linear_sweep_rate * 4.096 / (double)VDAC_REF_VOLTAGE / linear_sweep_sample_rate;
-        
-        // Ensure minimum step size to prevent zero steps when sample rate is high
-        if (step_per_sample > 0 && step_per_sample < 1.0) {
-            step_per_sample = 1.0;  // Minimum step of 1 VDAC unit
-        } else if (step_per_sample < 0 && step_per_sample > -1.0) {
-            step_per_sample = -1.0; // Minimum step of 1 VDAC unit (negative direction)
+        uint32_t period   = timebaseRateTicks(linear_sweep_sample_rate);
+        uint64_t step_q16 = (uint64_t)((double)linear_sweep_rate * 268435456.0 * period
+                                       / ((double)VDAC_REF_MV * timebase_hz) + 0.5);
+        if (vdac_drive == VDAC_DRIVE_BIPOLAR) {
+            step_q16 /= 2; // Every code moves the cell by two counts
         }
-        
+
+        // One sweep can never step past the whole VDAC range in a single tick
+        if (step_q16 > ((uint64_t)4095 << 16)) {
+            step_q16 = (uint64_t)4095 << 16;
+        }
+        // Ensure the sweep always moves when there's a voltage range to sweep
+        if (step_q16 == 0 && linear_sweep_rate > 0) {
+            step_q16 = 1;
+        }
+
         // Determine direction based on start and stop voltages
         if (vdacOUT_stop >= vdacOUT_start) {
-            linear_sweep_step = (int16_t)step_per_sample;
+            linear_sweep_step     = 1;
+            linear_sweep_step_q16 = (int32_t)step_q16;
         } else {
-            linear_sweep_step = -(int16_t)step_per_sample;
+            linear_sweep_step     = -1;
+            linear_sweep_step_q16 = -(int32_t)step_q16;
         }
-        
-        // Final safety check - ensure step is never zero when there's a voltage range to sweep
-        if (linear_sweep_step == 0 && vdacOUT_start != vdacOUT_stop) {
-            linear_sweep_step = (vdacOUT_stop > vdacOUT_start) ? 1 : -1;
+        if (vdacOUT_start == vdacOUT_stop) {
+            linear_sweep_step = 0;
         }
     } else {
         linear_sweep_step = 0;
+        linear_sweep_step_q16 = 0;
     }
 }
 
@@ -335,204 +880,1616 @@ void calculatePulseTiming(void) {
     }
 }
 
+// Worst case time from the scan trigger to SCANTABLEDONE for one profile
+uint32_t iadcConversionTimeNs(const iadc_profile_t *profile) {
+    uint32_t cycles;
+    if (profile->adcMode == iadcCfgModeHighAccuracy) {
+        cycles = 5 * (uint32_t)profile->osr + 7;
+    } else {
+        cycles = 4 * (uint32_t)profile->osr + 2;
+    }
+    uint64_t conversion_ns = (uint64_t)cycles * profile->avg * IADC_SCAN_ENTRIES * 1000000000ULL / profile->clkAdcFreq;
+    return IADC_WARMUP_NS + (uint32_t)conversion_ns;
+}
+
+// Timebase ticks the scan must be started ahead of the period end
+uint32_t iadcConversionTicks(const iadc_profile_t *profile) {
+    uint32_t ns = iadcConversionTimeNs(profile);
+    return (uint32_t)(((uint64_t)ns * timebase_hz + 999999999ULL) / 1000000000ULL) + IADC_COMPARE_MARGIN_TICKS;
+}
+
+// Latch the requested timebase and route its edges to the IADC and VDAC triggers
+void timebaseSelect(void) {
+    timebase_active = timebase_request;
+    if (timebase_active == TIMEBASE_HFTIMER) {
+        timebase_hz = CMU_ClockFreqGet(cmuClock_TIMER1);
+        PRS_SourceAsyncSignalSet(ADC_TRIG_PRS_CHANNEL,  PRS_ASYNC_CH_CTRL_SOURCESEL_TIMER1, PRS_TIMER1_CC0);
+        PRS_SourceAsyncSignalSet(VDAC_TRIG_PRS_CHANNEL, PRS_ASYNC_CH_CTRL_SOURCESEL_TIMER1, PRS_TIMER1_OF);
+    } else {
+        timebase_hz = LETIMER_CLOCK_HZ;
+        PRS_SourceAsyncSignalSet(ADC_TRIG_PRS_CHANNEL,  PRS_ASYNC_CH_CTRL_SOURCESEL_LETIMER0, PRS_LETIMER0_CH0);
+        PRS_SourceAsyncSignalSet(VDAC_TRIG_PRS_CHANNEL, PRS_ASYNC_CH_CTRL_SOURCESEL_LETIMER0, PRS_LETIMER0_CH1);
+    }
+}
+
+// Timebase ticks per SWV / pulse train sample slot, pulse_width_ms / iadcSAMPLESperPULSE rounded
+static inline uint32_t pulseSlotTicks(void) {
+    uint64_t slots = 1000ULL * iadcSAMPLESperPULSE;
+    return (uint32_t)(((uint64_t)pulse_width_ms * timebase_hz + slots / 2) / slots);
+}
+
+// Timebase ticks per impedance sample at frequency_dhz (0.1 Hz), rounded
+static inline uint32_t eisSampleTicks(uint16_t frequency_dhz) {
+    uint64_t steps = (uint64_t)WAVEFORM_SINE_STEPS * frequency_dhz;
+    return (steps > 0) ? (uint32_t)(((uint64_t)timebase_hz * 10 + steps / 2) / steps) : timebase_hz;
+}
+
+// Restart the timebase with periods of ticks from now on
+void timebasePeriodSet(uint32_t ticks) {
+    if (timebase_active == TIMEBASE_HFTIMER) {
+        // The compare follows the top, TIMER1 counts up
+        TIMER_TopSet(TIMEBASE_HF_TIMER, ticks - 1);
+        TIMER_CompareSet(TIMEBASE_HF_TIMER, 0, ticks - iadc_compare_ticks);
+        TIMER_CounterSet(TIMEBASE_HF_TIMER, 0);
+    } else {
+        LETIMER_TopSet(LETIMER0, ticks - 1);
+        LETIMER_CounterSet(LETIMER0, ticks - 1);
+    }
+}
+
+// Period after the one in progress; both timers only take a new top at the end of a period
+void timebaseNextPeriodSet(uint32_t ticks) {
+    if (timebase_active == TIMEBASE_HFTIMER) {
+        TIMER_TopBufSet(TIMEBASE_HF_TIMER, ticks - 1);
+        TIMER_CompareBufSet(TIMEBASE_HF_TIMER, 0, ticks - iadc_compare_ticks);
+    } else {
+        LETIMER_TopSet(LETIMER0, ticks - 1);
+    }
+}
+
+void timebaseStart(void) {
+    if (timebase_active == TIMEBASE_HFTIMER) {
+        // The HF clock has to stay up for the whole run
+        LETIMER_Enable(LETIMER0, false);
+        sl_power_manager_add_em_requirement(SL_POWER_MANAGER_EM1);
+        timebase_em1_held = true;
+        TIMER_Enable(TIMEBASE_HF_TIMER, true);
+    } else {
+        LETIMER_Enable(LETIMER0, true); // Start the timer
+    }
+}
+
+void timebaseStop(void) {
+    TIMER_Enable(TIMEBASE_HF_TIMER, false);
+    if (timebase_em1_held) {
+        sl_power_manager_remove_em_requirement(SL_POWER_MANAGER_EM1);
+        timebase_em1_held = false;
+    }
+}
+
+// SWV and the pulse train modes tick the LETIMER at pulse_width_ms / iadcSAMPLESperPULSE,
+// the other modes at linear_sweep_sample_rate
+static inline bool pulseTimedMode(void) {
+    return (operating_mode == 0) || (operating_mode >= 4 && operating_mode <= 6);
+}
+
+// Timebase period of the index-th sample after a chronoamperometry step
+static inline uint32_t chronoPeriodTicks(uint32_t index) {
+    uint32_t octave = index / CHRONO_SAMPLES_PER_OCTAVE;
+    if (octave >= 32 || ((uint64_t)chrono_fast_ticks << octave) >= chrono_slow_ticks) {
+        return chrono_slow_ticks;
+    }
+    return chrono_fast_ticks << octave;
+}
+
+// Fit the IADC profile to the sample period of the selected operating mode.
+// Auto picks the most accurate profile that converts within one sample period. A fixed profile
+// keeps its OSR and instead lowers the sample rate (samples per pulse for SWV) until it fits.
+// The lowered rate only applies to this measurement, every run starts again from the host's values.
+// Must run before the LETIMER top and pulse timing are derived from the sampling parameters.
+void planAcquisition(void) {
+    uint32_t period_ticks;
+    iadcSAMPLESperPULSE      = iadc_samples_per_pulse_request;
+    linear_sweep_sample_rate = linear_sweep_sample_rate_request;
+    chrono_fast_rate         = chrono_fast_rate_request;
+    timebaseSelect();
+    if (pulseTimedMode()) {
+        period_ticks = pulseSlotTicks();
+    } else if (operating_mode == 7) {
+        // The densest samples right after a step have to fit, the log-spaced ones do anyway
+        period_ticks = (chrono_fast_rate > 0) ? timebaseRateTicks(chrono_fast_rate) : 0;
+    } else if (operating_mode == 8) {
+        // The highest frequency sets the rate the IADC has to keep up with
+        period_ticks = timebase_hz;
+        for (uint8_t i = 0; i < eis_frequency_count; i++) {
+            uint32_t ticks = eisSampleTicks(eis_frequencies[i]);
+            if (ticks < period_ticks) {
+                period_ticks = ticks;
+            }
+        }
+    } else {
+        period_ticks = (linear_sweep_sample_rate > 0) ? timebaseRateTicks(linear_sweep_sample_rate) : 0;
+    }
+
+    uint8_t profile = iadc_profile_request;
+    iadc_plan_clamped = false;
+
+    if (profile == IADC_PROFILE_AUTO) {
+        profile = 0; // Fastest profile if nothing fits; then the period check below clamps the rate
+        for (uint8_t i = 0; i < IADC_PROFILE_COUNT; i++) {
+            if (iadcConversionTicks(&iadc_profiles[i]) < period_ticks) {
+                profile = i;
+            }
+        }
+    } else if (profile >= IADC_PROFILE_COUNT) {
+        profile = IADC_PROFILE_DEFAULT;
+    }
+
+    // The compare has to lie strictly inside the period: the LETIMER counts down from period - 1 and
+    // never reaches a compare of a whole period, TIMER1 would compare at its own reload
+    uint32_t ticks = iadcConversionTicks(&iadc_profiles[profile]);
+    if (ticks >= period_ticks) {
+        // Lower the rate until one conversion fits in the sample period
+        iadc_plan_clamped = true;
+        if (pulseTimedMode()) {
+            uint16_t samples = (uint16_t)((uint64_t)pulse_width_ms * timebase_hz / 1000 / (ticks + 1));
+            iadcSAMPLESperPULSE = (samples > 0) ? samples : 1;
+            BLE_packetSize = BLE_pulsePacketSize();
+            period_ticks = pulseSlotTicks();
+        } else if (operating_mode == 7) {
+            // waveformBuildChrono keeps the fast period above the compare
+            uint32_t rate = timebase_hz / (ticks + 1);
+            chrono_fast_rate = (rate > 0xFFFF) ? 0xFFFF : ((rate > 0) ? rate : 1);
+        } else if (operating_mode == 8) {
+            // waveformBuildEIS lowers the frequencies that convert too slowly, the records report them
+        } else {
+            uint32_t rate = timebase_hz / (ticks + 1);
+            linear_sweep_sample_rate = (rate > 0xFFFF) ? 0xFFFF : ((rate > 0) ? rate : 1);
+            period_ticks = timebaseRateTicks(linear_sweep_sample_rate);
+        }
+
+        // Pulses too short for even one conversion still get a compare that matches
+        if (operating_mode != 7 && operating_mode != 8 && ticks >= period_ticks) {
+            ticks = (period_ticks > 1) ? period_ticks - 1 : 1;
+        }
+    }
+
+    // A longer lead samples earlier after the step; the conversion still fits, and the scan never
+    // starts before the step that opens the shortest period of the plan
+    uint32_t lead_ticks = (uint32_t)(((uint64_t)iadc_sample_lead_us * timebase_hz + 500000) / 1000000);
+    if (lead_ticks > ticks && !iadc_plan_clamped) {
+        uint32_t latest = (period_ticks > ticks) ? period_ticks - 1 : ticks;
+        ticks = (lead_ticks < latest) ? lead_ticks : latest;
+    }
+
+    iadc_compare_ticks = ticks;
+
+    // Re-initialize the IADC only when the profile actually changes
+    if (profile != iadc_active_profile) {
+        iadc_active_profile = profile;
+        IADC_reset(IADC0);
+        initIADC();
+    }
+    if (timebase_active == TIMEBASE_LETIMER) {
+        LETIMER_CompareSet(LETIMER0, 0, iadc_compare_ticks);
+    }
+
+    // Report the plan: profile, clamped flag, samples per pulse, sample rate (Hz), conversion time (us),
+    // compare ticks (of the active timebase, saturated at 0xFFFF), scan start before the period end (us)
+    uint8_t plan[14];
+    uint16_t conversion_us = (uint16_t)(iadcConversionTimeNs(&iadc_profiles[profile]) / 1000);
+    plan[0] = profile;
+    plan[1] = iadc_plan_clamped;
+    plan[2] = iadcSAMPLESperPULSE & 0xFF;
+    plan[3] = (iadcSAMPLESperPULSE >> 8) & 0xFF;
+    plan[4] = linear_sweep_sample_rate & 0xFF;
+    plan[5] = (linear_sweep_sample_rate >> 8) & 0xFF;
+    plan[6] = conversion_us & 0xFF;
+    plan[7] = (conversion_us >> 8) & 0xFF;
+    uint16_t compare_ticks = (iadc_compare_ticks > 0xFFFF) ? 0xFFFF : iadc_compare_ticks;
+    plan[8] = compare_ticks & 0xFF;
+    plan[9] = (compare_ticks >> 8) & 0xFF;
+    uint32_t lead_us = (uint32_t)(((uint64_t)iadc_compare_ticks * 1000000 + timebase_hz / 2) / timebase_hz);
+    plan[10] = lead_us & 0xFF;
+    plan[11] = (lead_us >> 8) & 0xFF;
+    plan[12] = (lead_us >> 16) & 0xFF;
+    plan[13] = (lead_us >> 24) & 0xFF;
+    sl_bt_gatt_server_write_attribute_value(gattdb_ADC_PLAN, 0, sizeof(plan), plan);
+}
+
+// Number of leading sample slots whose conversion would start less than delay_us after the step
+uint32_t slotsBeforeDelay(uint32_t delay_us, uint32_t period_ticks) {
+    uint32_t delay_ticks = (uint32_t)(((uint64_t)delay_us * timebase_hz + 999999) / 1000000);
+    uint32_t first_slot  = (delay_ticks + iadc_compare_ticks + period_ticks - 1) / period_ticks;
+    return (first_slot > 0) ? first_slot - 1 : 0;
+}
+
+// Convert the SWV sampling window into a number of leading sample slots to skip per half-period.
+// Slot k (1..iadcSAMPLESperPULSE) starts converting iadc_compare_ticks before the end of its period,
+// i.e. at k * period_ticks - iadc_compare_ticks after the potential step. The last slot is always kept.
+void planSampleWindow(uint32_t period_ticks) {
+    uint32_t skip = 0;
+
+    if (pulseTimedMode() && period_ticks > 0) {
+        if (sample_window_count > 0 && sample_window_count < iadcSAMPLESperPULSE) {
+            skip = iadcSAMPLESperPULSE - sample_window_count;
+        }
+
+        uint32_t delay_skip = slotsBeforeDelay(sample_window_delay_us, period_ticks);
+        if (delay_skip > skip) {
+            skip = delay_skip;
+        }
+
+        if (skip > (uint32_t)iadcSAMPLESperPULSE - 1) {
+            skip = iadcSAMPLESperPULSE - 1;
+        }
+
+        // Electrode settling blanks out at least as much as the window after every mux switch
+        uint32_t settle_skip = slotsBeforeDelay(electrode_settle_us, period_ticks);
+        if (settle_skip < skip) {
+            settle_skip = skip;
+        }
+        if (settle_skip > (uint32_t)iadcSAMPLESperPULSE - 1) {
+            settle_skip = iadcSAMPLESperPULSE - 1;
+        }
+        electrode_settle_skip = settle_skip;
+    } else {
+        electrode_settle_skip = 0;
+    }
+
+    iadc_window_skip = skip;
+    iadc_half_skip   = skip;
+}
+
+// True when sample slot sample_count (1-based, as counted by LETIMER0_IRQHandler) lies in the window
+static inline bool sampleInWindow(uint32_t sample_count) {
+    return (iadc_half_skip == 0) ||
+           (((sample_count - 1) % iadcSAMPLESperPULSE) >= iadc_half_skip);
+}
+
+// Drive the C_A2..C_A0 mux lines (pins are already outputs after startNewMeasurement)
+void selectElectrode(uint8_t electrode) {
+#if RUN_MODE == 1 || RUN_MODE == 2
+    if (electrode & 0x1) GPIO_PinOutSet(C_A0_PORT, C_A0_PIN); else GPIO_PinOutClear(C_A0_PORT, C_A0_PIN);
+    if (electrode & 0x2) GPIO_PinOutSet(C_A1_PORT, C_A1_PIN); else GPIO_PinOutClear(C_A1_PORT, C_A1_PIN);
+    if (electrode & 0x4) GPIO_PinOutSet(C_A2_PORT, C_A2_PIN); else GPIO_PinOutClear(C_A2_PORT, C_A2_PIN);
+#endif
+    electrode_active = electrode;
+}
+
+// Build the electrode list from electrode_mask; round-robin needs SWV and at least one electrode
+void planElectrodeScan(void) {
+    electrode_list_count = 0;
+    for (uint8_t e = 0; e < ELECTRODE_COUNT; e++) {
+        if (electrode_mask & (1 << e)) {
+            electrode_list[electrode_list_count++] = e;
+        }
+    }
+
+    electrode_scan_active = (operating_mode == 0) &&
+                            (electrode_scan_mode != ELECTRODE_SCAN_OFF) &&
+                            (electrode_list_count > 0);
+    electrode_active = electrode_scan_active ? electrode_list[0] : electrode_channel;
+}
+
+// Drive the F_A1/F_A0 feedback select lines (pins are already outputs after startNewMeasurement)
+void selectGain(uint8_t gain) {
+#if RUN_MODE == 1 || RUN_MODE == 2
+    if (gain & 0x1) GPIO_PinOutSet(F_A0_PORT, F_A0_PIN); else GPIO_PinOutClear(F_A0_PORT, F_A0_PIN);
+    if (gain & 0x2) GPIO_PinOutSet(F_A1_PORT, F_A1_PIN); else GPIO_PinOutClear(F_A1_PORT, F_A1_PIN);
+#endif
+    gain_active = gain;
+}
+
+// Every electrode starts the run at the hand-picked gain_channel
+void planGainAutorange(void) {
+    uint8_t rank = 0;
+    for (uint8_t r = 0; r < GAIN_COUNT; r++) {
+        if (gain_order[r] == gain_channel) {
+            rank = r;
+        }
+    }
+    for (uint8_t e = 0; e < ELECTRODE_COUNT; e++) {
+        gain_rank[e] = rank;
+        gain_rank_pending[e] = rank;
+    }
+
+#if RUN_MODE == 1 || RUN_MODE == 2
+    gain_autorange_active = (operating_mode == 0) && gain_autorange;
+#else
+    gain_autorange_active = false;
+#endif
+    gain_active = gain_channel;
+}
+
+// Apply the autoranger's choice for the electrode about to be measured; returns true if the gain changed
+static bool applyPendingGain(uint8_t electrode) {
+    electrode &= ELECTRODE_COUNT - 1;
+    gain_rank[electrode] = gain_rank_pending[electrode];
+    uint8_t gain = gain_order[gain_rank[electrode]];
+    if (gain == gain_active) {
+        return false;
+    }
+    selectGain(gain);
+    return true;
+}
+
+// Decide the next gain of one electrode from the ch0 extremes of a completed half-period
+static void autorangeHalfPeriod(uint8_t electrode, uint8_t gain)
+{
+    electrode &= ELECTRODE_COUNT - 1;
+    uint8_t rank = 0;
+    for (uint8_t r = 0; r < GAIN_COUNT; r++) {
+        if (gain_order[r] == gain) {
+            rank = r;
+        }
+    }
+
+    if (autorange_max_ch0 >= AUTORANGE_CLIP_HIGH_CODE || autorange_min_ch0 <= AUTORANGE_CLIP_LOW_CODE) {
+        // Clipping (or about to): less feedback resistance
+        if (rank > 0 && gain_rank_pending[electrode] >= rank) {
+            gain_rank_pending[electrode] = rank - 1;
+        }
+    } else if (rank + 1 < GAIN_COUNT && gain_rank_pending[electrode] == rank) {
+        // Predict the swing around the TIA bias at the next resistor and step up only if it still fits
+        uint32_t r_now  = gain_resistor_ohms[gain];
+        uint32_t r_next = gain_resistor_ohms[gain_order[rank + 1]];
+        int64_t  low    = (int64_t)AUTORANGE_BIAS_CODE + ((int64_t)autorange_min_ch0 - AUTORANGE_BIAS_CODE) * r_next / r_now;
+        int64_t  high   = (int64_t)AUTORANGE_BIAS_CODE + ((int64_t)autorange_max_ch0 - AUTORANGE_BIAS_CODE) * r_next / r_now;
+        if (low >= AUTORANGE_FIT_LOW_CODE && high <= AUTORANGE_FIT_HIGH_CODE) {
+            gain_rank_pending[electrode] = rank + 1;
+        }
+    }
+
+    autorange_min_ch0 = ADC_FULL_SCALE_CODE;
+    autorange_max_ch0 = 0;
+}
+
+// Append one segment to waveform_segments[]; a full list is reported by waveformCompile()
+static void waveformAddSegment(uint8_t kind, uint8_t marks, int16_t value, uint32_t ticks) {
+    if (waveform_segment_count >= WAVEFORM_MAX_SEGMENTS) {
+        waveform_status = WAVEFORM_ERR_SIZE;
+        return;
+    }
+    waveform_segment_t *seg = &waveform_segments[waveform_segment_count++];
+    seg->kind  = kind;
+    seg->marks = marks;
+    seg->value = value;
+    seg->ticks = ticks;
+}
+
+// SWV: half-periods of iadcSAMPLESperPULSE periods around a base that steps by vdacOUT_step.
+// Round-robin repeats each half-period (per pulse) or each step (per step) on every electrode.
+static void waveformBuildSWV(void) {
+    uint32_t n          = iadcSAMPLESperPULSE;
+    uint8_t  electrodes = (electrode_scan_active && electrode_list_count > 1) ? electrode_list_count : 1;
+    uint8_t  mark_e     = (electrodes > 1) ? WAVEFORM_EVENT_ELECTRODE : 0;
+    uint8_t  mark_b     = WAVEFORM_EVENT_BOUNDARY;
+    uint8_t  mark_h     = WAVEFORM_EVENT_HALF;
+    uint8_t  mark_s     = WAVEFORM_EVENT_STEP_START;
+
+    // Steps after the first one whose base is still within vdacOUT_stop (endless for a zero step)
+    int32_t span  = (int32_t)vdacOUT_stop - (int32_t)vdacOUT_start;
+    int32_t steps = (vdacOUT_step != 0) ? span / vdacOUT_step : 0;
+
+    // The first underflow already lies inside the first half-period, which has no pulse applied
+    waveformAddSegment(WAVEFORM_SEG_HOLD, 0, vdacOUT_start, n - 1);
+
+    if (electrodes > 1 && electrode_scan_mode == ELECTRODE_SCAN_PER_PULSE) {
+        waveformAddSegment(WAVEFORM_SEG_PULSE,  mark_b | mark_e | mark_s, 0, n);
+        waveformAddSegment(WAVEFORM_SEG_REPEAT, 0, 1, electrodes - 1);
+        waveformAddSegment(WAVEFORM_SEG_PULSE,  mark_b | mark_e | mark_h, -vdacOUT_pulse, n);
+        waveformAddSegment(WAVEFORM_SEG_PULSE,  mark_b | mark_e, -vdacOUT_pulse, n);
+        waveformAddSegment(WAVEFORM_SEG_REPEAT, 0, 1, electrodes - 1);
+        if (vdacOUT_step == 0 || steps > 0) {
+            uint8_t body = waveform_segment_count;
+            waveformAddSegment(WAVEFORM_SEG_STEP,   0, vdacOUT_step, 0);
+            waveformAddSegment(WAVEFORM_SEG_PULSE,  mark_b | mark_e | mark_h | mark_s, vdacOUT_pulse, n);
+            waveformAddSegment(WAVEFORM_SEG_PULSE,  mark_b | mark_e | mark_s, vdacOUT_pulse, n);
+            waveformAddSegment(WAVEFORM_SEG_REPEAT, 0, 1, electrodes - 1);
+            waveformAddSegment(WAVEFORM_SEG_PULSE,  mark_b | mark_e | mark_h, -vdacOUT_pulse, n);
+            waveformAddSegment(WAVEFORM_SEG_PULSE,  mark_b | mark_e, -vdacOUT_pulse, n);
+            waveformAddSegment(WAVEFORM_SEG_REPEAT, 0, 1, electrodes - 1);
+            waveformAddSegment(WAVEFORM_SEG_REPEAT, 0, waveform_segment_count - body, (uint32_t)steps);
+        }
+    } else {
+        waveformAddSegment(WAVEFORM_SEG_PULSE, mark_b | mark_h, -vdacOUT_pulse, n);
+        if (electrodes > 1) {
+            // The other electrodes catch up on the first step
+            waveformAddSegment(WAVEFORM_SEG_PULSE,  mark_b | mark_e | mark_h | mark_s, vdacOUT_pulse, n);
+            waveformAddSegment(WAVEFORM_SEG_PULSE,  mark_b | mark_h, -vdacOUT_pulse, n);
+            waveformAddSegment(WAVEFORM_SEG_REPEAT, 0, 2, electrodes - 1);
+        }
+        if (vdacOUT_step == 0 || steps > 0) {
+            uint8_t body = waveform_segment_count;
+            waveformAddSegment(WAVEFORM_SEG_STEP,  0, vdacOUT_step, 0);
+            waveformAddSegment(WAVEFORM_SEG_PULSE, mark_b | mark_e | mark_h | mark_s, vdacOUT_pulse, n);
+            waveformAddSegment(WAVEFORM_SEG_PULSE, mark_b | mark_h, -vdacOUT_pulse, n);
+            if (electrodes > 1) {
+                waveformAddSegment(WAVEFORM_SEG_REPEAT, 0, 2, electrodes);
+            }
+            waveformAddSegment(WAVEFORM_SEG_REPEAT, 0, waveform_segment_count - body, (uint32_t)steps);
+        }
+    }
+}
+
+// One cycle of ramps from vdacOUT_start through the vertices, each landing exactly on its vertex
+static void waveformAddSweepLegs(const uint16_t *vertices, uint8_t count, uint32_t rate, uint8_t first_marks) {
+    int32_t from = vdacOUT_start;
+    for (uint8_t i = 0; i < count; i++) {
+        int32_t  span      = (int32_t)vertices[i] - from;
+        uint32_t magnitude = (span < 0) ? -span : span;
+        uint32_t ticks     = (uint32_t)((((uint64_t)magnitude << 16) + rate - 1) / rate);
+        if (ticks == 0) {
+            ticks = 1; // Turns at the next period even with no span, like the accumulator did
+        }
+        waveformAddSegment(WAVEFORM_SEG_RAMP, (i == 0) ? first_marks : 0, (int16_t)span, ticks);
+        from = vertices[i];
+    }
+}
+
+// Pulse period in whole pulse widths
+static uint32_t pulsePeriodHalves(void) {
+    uint32_t halves = ((uint32_t)pulse_period_ms + pulse_width_ms / 2) / pulse_width_ms;
+    return (halves < 2) ? 2 : halves;
+}
+
+// DPV: per step, unsampled base half-periods, one sampled base half-period and the pulse.
+// Base and pulse halves get even and odd vdacOUT_count like the SWV pairs, so the difference
+// stream pairs them per step (pulse mean - base mean).
+static void waveformBuildDPV(void) {
+    uint32_t n      = iadcSAMPLESperPULSE;
+    uint32_t halves = pulsePeriodHalves();
+
+    // Every base potential from vdacOUT_start up to vdacOUT_stop gets a pulse (endless for a zero step)
+    int32_t  span  = (int32_t)vdacOUT_stop - (int32_t)vdacOUT_start;
+    int32_t  steps = (vdacOUT_step != 0) ? span / vdacOUT_step : 0;
+    uint32_t count = (vdacOUT_step == 0) ? 0 : ((steps > 0) ? (uint32_t)steps + 1 : 1);
+
+    // First half-period at the start potential is not paired; skip half 1 so that base halves are even
+    waveformAddSegment(WAVEFORM_SEG_HOLD, 0, vdacOUT_start, n - 1);
+    waveformAddSegment(WAVEFORM_SEG_STEP, WAVEFORM_EVENT_HALF, 0, 0);
+
+    uint8_t body = waveform_segment_count;
+    if (halves > 2) {
+        waveformAddSegment(WAVEFORM_SEG_PULSE, WAVEFORM_EVENT_BOUNDARY | WAVEFORM_EVENT_NO_SAMPLE, 0, n * (halves - 2));
+    }
+    waveformAddSegment(WAVEFORM_SEG_PULSE, WAVEFORM_EVENT_BOUNDARY | WAVEFORM_EVENT_HALF, 0, n);
+    // vdacOUT_pulse is stored against the scan direction (see the Pulse Height handler)
+    waveformAddSegment(WAVEFORM_SEG_PULSE, WAVEFORM_EVENT_BOUNDARY | WAVEFORM_EVENT_HALF | WAVEFORM_EVENT_STEP_START, -vdacOUT_pulse, n);
+    waveformAddSegment(WAVEFORM_SEG_STEP,  0, vdacOUT_step, 0);
+    waveformAddSegment(WAVEFORM_SEG_REPEAT, 0, waveform_segment_count - body, count);
+}
+
+// NPV / RPV: unsampled rest at a fixed base, then a sampled pulse that moves one step further every
+// period. The base register tracks the pulse level, the rest is a LEVEL segment so it stays put.
+static void waveformBuildNormalPulse(uint16_t base, int16_t step) {
+    uint32_t n      = iadcSAMPLESperPULSE;
+    uint32_t halves = pulsePeriodHalves();
+
+    // Pulses to base + step up to base + steps * step, the span covering vdacOUT_start to vdacOUT_stop
+    int32_t  span  = (int32_t)vdacOUT_stop - (int32_t)vdacOUT_start;
+    int32_t  steps = (vdacOUT_step != 0) ? span / vdacOUT_step : 0;
+    uint32_t count = (vdacOUT_step == 0) ? 0 : ((steps > 0) ? (uint32_t)steps : 1);
+
+    waveformAddSegment(WAVEFORM_SEG_HOLD, 0, base, n - 1);
+
+    uint8_t body = waveform_segment_count;
+    waveformAddSegment(WAVEFORM_SEG_LEVEL, WAVEFORM_EVENT_BOUNDARY | WAVEFORM_EVENT_HALF | WAVEFORM_EVENT_NO_SAMPLE,
+                       base, n * (halves - 1));
+    waveformAddSegment(WAVEFORM_SEG_STEP,  WAVEFORM_EVENT_BOUNDARY | WAVEFORM_EVENT_HALF | WAVEFORM_EVENT_STEP_START,
+                       step, n);
+    waveformAddSegment(WAVEFORM_SEG_REPEAT, 0, waveform_segment_count - body, count);
+
+    // Back to the base once the last pulse is done
+    waveformAddSegment(WAVEFORM_SEG_LEVEL, WAVEFORM_EVENT_BOUNDARY | WAVEFORM_EVENT_NO_SAMPLE, base, 1);
+}
+
+// Sample periods that cover a chronoamperometry step of duration_ms (the last one may overrun it)
+static uint32_t chronoStepPeriods(uint16_t duration_ms) {
+    uint32_t remaining = (uint32_t)(((uint64_t)duration_ms * timebase_hz + 500) / 1000);
+    uint32_t index     = 0;
+    while (remaining > 0) {
+        uint32_t period = chronoPeriodTicks(index);
+        if (period >= chrono_slow_ticks) {
+            // Past the log-spaced part every period is the same
+            return index + (remaining + period - 1) / period;
+        }
+        remaining = (remaining > period) ? remaining - period : 0;
+        index++;
+    }
+    return index;
+}
+
+// Chronoamperometry: one HOLD per step, counted in sample periods of the log-spaced schedule
+static void waveformBuildChrono(void) {
+    chrono_fast_ticks = timebaseRateTicks(chrono_fast_rate);
+    if (chrono_fast_ticks <= iadc_compare_ticks) {
+        chrono_fast_ticks = iadc_compare_ticks + 1;
+    }
+    chrono_slow_ticks = timebaseRateTicks(linear_sweep_sample_rate);
+    if (chrono_slow_ticks < chrono_fast_ticks) {
+        chrono_slow_ticks = chrono_fast_ticks;
+    }
+
+    for (uint8_t i = 0; i < chrono_step_count; i++) {
+        waveformAddSegment(WAVEFORM_SEG_HOLD, WAVEFORM_EVENT_BOUNDARY | WAVEFORM_EVENT_HALF | WAVEFORM_EVENT_STEP_START,
+                           (int16_t)chrono_steps[i].potential, chronoStepPeriods(chrono_steps[i].duration_ms));
+    }
+}
+
+// Impedance: one sine segment per frequency around vdacOUT_start, settling periods included
+static void waveformBuildEIS(void) {
+    uint32_t ticks_per_point = (uint32_t)(EIS_SETTLE_PERIODS + eis_periods) * WAVEFORM_SINE_STEPS;
+
+    for (uint8_t i = 0; i < eis_frequency_count; i++) {
+        uint32_t ticks = eisSampleTicks(eis_frequencies[i]);
+        if (ticks <= iadc_compare_ticks) {
+            ticks = iadc_compare_ticks + 1;
+        }
+        eis_point_ticks[i] = ticks;
+        waveformAddSegment(WAVEFORM_SEG_SINE, WAVEFORM_EVENT_BOUNDARY | WAVEFORM_EVENT_HALF | WAVEFORM_EVENT_STEP_START,
+                           (int16_t)eis_amplitude, ticks_per_point);
+    }
+
+    // Back to the bias once the last frequency is done
+    waveformAddSegment(WAVEFORM_SEG_LEVEL, WAVEFORM_EVENT_BOUNDARY | WAVEFORM_EVENT_NO_SAMPLE, vdacOUT_start, 1);
+}
+
+// Linear sweep: start -> vertices -> start at linear_sweep_step_q16 per period, linear_sweep_cycles times
+static void waveformBuildLinearSweep(void) {
+    uint16_t vertices[LINEAR_SWEEP_MAX_VERTICES + 1];
+    uint8_t  count = 0;
+    uint32_t rate  = (linear_sweep_step_q16 < 0) ? -linear_sweep_step_q16 : linear_sweep_step_q16;
+
+    if (linear_sweep_vertex_count == 0) {
+        vertices[count++] = vdacOUT_stop;
+    }
+    for (uint8_t i = 0; i < linear_sweep_vertex_count; i++) {
+        vertices[count++] = linear_sweep_vertices[i];
+    }
+    vertices[count++] = vdacOUT_start; // Every cycle closes on the start potential
+
+    waveformAddSegment(WAVEFORM_SEG_HOLD, 0, vdacOUT_start, 0);
+    if (rate == 0) {
+        waveformAddSegment(WAVEFORM_SEG_REPEAT, 0, 0, 0); // No sweep rate: hold the start potential
+        return;
+    }
+
+    waveformAddSweepLegs(vertices, count, rate, 0);
+    if (linear_sweep_cycles != 1) {
+        // The remaining cycles follow without a pause, each one announced on its first leg
+        waveformAddSweepLegs(vertices, count, rate, WAVEFORM_EVENT_CYCLE);
+        waveformAddSegment(WAVEFORM_SEG_REPEAT, 0, count, (linear_sweep_cycles == 0) ? 0 : linear_sweep_cycles - 1);
+    }
+}
+
+// Pulse mode: start, start + pulse_height for the pulse width, then stop
+static void waveformBuildPulse(void) {
+    waveformAddSegment(WAVEFORM_SEG_HOLD,  0, vdacOUT_start, pulse_before_ticks - 1);
+    waveformAddSegment(WAVEFORM_SEG_PULSE, 0, pulse_height,  pulse_width_ticks);
+    waveformAddSegment(WAVEFORM_SEG_HOLD,  0, vdacOUT_stop,  pulse_after_ticks);
+}
+
+// Timebase periods of the pre-phase in duration_ds, rounded up
+static uint32_t prephasePeriods(uint16_t duration_ds) {
+    uint64_t period = 10ULL * prephase_period_ticks;
+    return (uint32_t)(((uint64_t)duration_ds * timebase_hz + period - 1) / period);
+}
+
+// Pre-phase: one hold per step, or the plain unsampled hold of time_before_trial
+static void waveformBuildPrephase(void) {
+    uint32_t n = iadcSAMPLESperPULSE;
+
+    if (prephase_step_count == 0) {
+        uint32_t ticks = prephasePeriods(time_before_trial * 10);
+        waveformAddSegment(WAVEFORM_SEG_HOLD, WAVEFORM_EVENT_BOUNDARY | WAVEFORM_EVENT_NO_SAMPLE, vdacOUT_start, (ticks > 1) ? ticks - 1 : 1);
+        return;
+    }
+
+    for (uint8_t i = 0; i < prephase_step_count; i++) {
+        const prephase_step_t *step = &prephase_steps[i];
+        uint32_t ticks = (prephasePeriods(step->duration_ds) + n - 1) / n * n;
+        if (ticks == 0) {
+            ticks = n;
+        }
+        if (i == 0) {
+            ticks -= 1; // The first period already runs at vdacOUT_start
+        }
+        if (step->potential == PREPHASE_OPEN_CIRCUIT) {
+            waveformAddSegment(WAVEFORM_SEG_HOLD, WAVEFORM_EVENT_BOUNDARY | WAVEFORM_EVENT_STEP_START | WAVEFORM_EVENT_OPEN_CIRCUIT,
+                               vdacOUT_start, ticks);
+        } else {
+            waveformAddSegment(WAVEFORM_SEG_HOLD, WAVEFORM_EVENT_BOUNDARY | WAVEFORM_EVENT_STEP_START, step->potential, ticks);
+        }
+    }
+}
+
+// Custom program: the segments as uploaded to the Waveform Program characteristic
+static void waveformBuildUploaded(void) {
+    for (uint8_t i = 0; i + WAVEFORM_SEGMENT_SIZE <= waveform_program_len; i += WAVEFORM_SEGMENT_SIZE) {
+        const uint8_t *raw = &waveform_program[i];
+        waveformAddSegment(raw[0], raw[1] & WAVEFORM_SEGMENT_MARKS,
+                           (int16_t)(raw[2] | (raw[3] << 8)),
+                           (uint32_t)raw[4] | ((uint32_t)raw[5] << 8) | ((uint32_t)raw[6] << 16) | ((uint32_t)raw[7] << 24));
+    }
+}
+
+static bool waveformAddOp(const waveform_op_t *op) {
+    if (waveform_op_count >= WAVEFORM_MAX_OPS) {
+        return false;
+    }
+    waveform_ops[waveform_op_count++] = *op;
+    return true;
+}
+
+// Translate waveform_segments[] into waveform_ops[]; returns a WAVEFORM_ERR_ code or WAVEFORM_OK
+static uint8_t waveformCompile(void) {
+    uint8_t seg_op[WAVEFORM_MAX_SEGMENTS];    // First op of every segment
+    uint8_t seg_depth[WAVEFORM_MAX_SEGMENTS]; // Repeats nested in and including a REPEAT segment
+
+    waveform_op_count = 0;
+    for (uint8_t i = 0; i < waveform_segment_count; i++) {
+        const waveform_segment_t *seg = &waveform_segments[i];
+        waveform_op_t op = {0};
+        op.opcode    = WAVEFORM_OP_RUN;
+        op.events    = seg->marks;
+        op.ticks     = seg->ticks;
+        seg_op[i]    = waveform_op_count;
+        seg_depth[i] = 0;
+
+        switch (seg->kind) {
+          case WAVEFORM_SEG_HOLD:
+            op.absolute = true;
+            op.base_q16 = (int32_t)seg->value << 16;
+            break;
+
+          case WAVEFORM_SEG_STEP:
+            op.base_q16 = (int32_t)seg->value << 16;
+            break;
+
+          case WAVEFORM_SEG_PULSE:
+            op.offset_q16 = (int32_t)seg->value << 16;
+            break;
+
+          case WAVEFORM_SEG_LEVEL:
+            op.fixed      = true;
+            op.offset_q16 = (int32_t)seg->value << 16;
+            break;
+
+          case WAVEFORM_SEG_SINE:
+            if (seg->value > WAVEFORM_SINE_AMP_MAX || seg->value < -WAVEFORM_SINE_AMP_MAX) {
+                return WAVEFORM_ERR_AMPLITUDE;
+            }
+            op.sine_amp = seg->value;
+            break;
+
+          case WAVEFORM_SEG_RAMP:
+            if (seg->ticks > 1) {
+                // Slope over all but the last period, which lands on the exact end level
+                op.slope_q16  = (int32_t)(((int64_t)seg->value << 16) / (int64_t)seg->ticks);
+                op.offset_q16 = op.slope_q16;
+                op.ticks      = seg->ticks - 1;
+                if (!waveformAddOp(&op)) {
+                    return WAVEFORM_ERR_SIZE;
+                }
+                op.events     = 0;
+                op.slope_q16  = 0;
+                op.offset_q16 = 0;
+                op.ticks      = 1;
+            }
+            op.base_q16 = (int32_t)seg->value << 16;
+            break;
+
+          case WAVEFORM_SEG_REPEAT: {
+            if (seg->value <= 0 || seg->value > i) {
+                return WAVEFORM_ERR_REPEAT;
+            }
+            uint8_t body = (uint8_t)seg->value;
+            uint8_t first = i - body;
+            uint8_t depth = 0;
+            bool    timed = false;
+            for (uint8_t j = first; j < i; j++) {
+                const waveform_segment_t *inner = &waveform_segments[j];
+                if (inner->kind == WAVEFORM_SEG_REPEAT) {
+                    // A repeat inside the body must not reach back past the body's first segment
+                    if (j - inner->value < first) {
+                        return WAVEFORM_ERR_REPEAT;
+                    }
+                    if (seg_depth[j] > depth) {
+                        depth = seg_depth[j];
+                    }
+                } else if (inner->ticks > 0) {
+                    timed = true;
+                }
+            }
+            seg_depth[i] = depth + 1;
+            if (seg_depth[i] > WAVEFORM_LOOP_DEPTH) {
+                return WAVEFORM_ERR_DEPTH;
+            }
+            if (seg->ticks == 0 && !timed) {
+                return WAVEFORM_ERR_EMPTY_LOOP;
+            }
+            op.opcode = WAVEFORM_OP_LOOP;
+            op.events = 0;
+            op.body   = waveform_op_count - seg_op[first];
+            break;
+          }
+
+          default:
+            return WAVEFORM_ERR_KIND;
+        }
+
+        if (!waveformAddOp(&op)) {
+            return WAVEFORM_ERR_SIZE;
+        }
+    }
+
+    waveform_op_t end = {0};
+    end.opcode = WAVEFORM_OP_END;
+    if (!waveformAddOp(&end)) {
+        return WAVEFORM_ERR_SIZE;
+    }
+    return WAVEFORM_OK;
+}
+
+// Describe the pre-phase or the selected operating mode as segments and compile them (timing must already be planned).
+// A program that does not compile finishes at the first period; the reason is in Waveform Status.
+void waveformPlan(void) {
+    waveform_segment_count = 0;
+    waveform_status = WAVEFORM_OK;
+
+    if (prephase_running) {
+        waveformBuildPrephase();
+    } else if (operating_mode == 0) {
+        waveformBuildSWV();
+    } else if (operating_mode == 1) {
+        waveformBuildLinearSweep();
+    } else if (operating_mode == 2) {
+        waveformBuildPulse();
+    } else if (operating_mode == 3) {
+        waveformBuildUploaded();
+    } else if (operating_mode == 4) {
+        waveformBuildDPV();
+    } else if (operating_mode == 5) {
+        waveformBuildNormalPulse(vdacOUT_start, vdacOUT_step);
+    } else if (operating_mode == 6) {
+        waveformBuildNormalPulse(vdacOUT_stop, -vdacOUT_step);
+    } else if (operating_mode == 7) {
+        waveformBuildChrono();
+    } else if (operating_mode == 8) {
+        waveformBuildEIS();
+    }
+
+    if (waveform_status == WAVEFORM_OK) {
+        waveform_status = waveformCompile();
+    }
+    if (waveform_status != WAVEFORM_OK) {
+        waveform_ops[0].opcode = WAVEFORM_OP_END;
+        waveform_op_count = 1;
+    }
+
+    waveform_cycle_tagged = false;
+    for (uint8_t i = 0; i < waveform_op_count; i++) {
+        if (waveform_ops[i].events & WAVEFORM_EVENT_CYCLE) {
+            waveform_cycle_tagged = true;
+        }
+    }
+
+    // Report the compile result: status, op count
+    uint8_t status[2];
+    status[0] = waveform_status;
+    status[1] = waveform_op_count;
+    sl_bt_gatt_server_write_attribute_value(gattdb_WAVEFORM_STATUS, 0, sizeof(status), status);
+}
+
+// Rewind to the start of the compiled program
+void waveformReset(waveform_state_t *w) {
+    w->pc              = 0;
+    w->ticks_left      = 0;
+    w->base_q16        = (int32_t)vdacOUT_start << 16;
+    w->out_q16         = w->base_q16;
+    w->slope_q16       = 0;
+    w->sine_amp        = 0;
+    w->phase           = 0;
+    w->loop_depth      = 0;
+    w->half_period     = 0;
+    w->cycle           = 0;
+    w->value           = vdacOUT_start;
+    w->electrode_index = 0;
+    w->finished        = false;
+}
+
+// Nearest whole VDAC count of a Q16.16 level, held inside the 12-bit range
+static inline uint16_t waveformLevel(int32_t level_q16) {
+    if (level_q16 <= 0) {
+        return 0;
+    }
+    if (level_q16 >= (4095 << 16)) {
+        return 4095;
+    }
+    return (uint16_t)((level_q16 + 0x8000) >> 16);
+}
+
+// Enter the next op that takes time, following loops; returns the events raised on the way
+static uint8_t waveformEnter(waveform_state_t *w) {
+    uint8_t events = 0;
+
+    for (;;) {
+        const waveform_op_t *op = &waveform_ops[w->pc];
+
+        if (op->opcode == WAVEFORM_OP_LOOP) {
+            // First arrival at this loop pushes its iteration count, later arrivals count it down
+            if (w->loop_depth == 0 || w->loop_pc[w->loop_depth - 1] != w->pc) {
+                w->loop_pc[w->loop_depth]   = w->pc;
+                w->loop_left[w->loop_depth] = op->ticks;
+                w->loop_depth++;
+            }
+            uint32_t *left = &w->loop_left[w->loop_depth - 1];
+            if (*left == 0 || --(*left) > 0) {
+                w->pc -= op->body;
+            } else {
+                w->loop_depth--;
+                w->pc++;
+            }
+            continue;
+        }
+
+        if (op->opcode == WAVEFORM_OP_END) {
+            // Hold whatever was output last
+            w->finished = true;
+            events |= WAVEFORM_EVENT_FINISHED;
+            break;
+        }
+
+        w->base_q16  = op->absolute ? op->base_q16 : w->base_q16 + op->base_q16;
+        w->out_q16   = op->fixed ? op->offset_q16 : w->base_q16 + op->offset_q16;
+        w->slope_q16 = op->slope_q16;
+        w->sine_amp  = op->sine_amp;
+        w->phase     = 0;
+        events |= op->events;
+        w->pc++;
+
+        // Counted per op, so zero-tick ops can advance the counters on their own
+        if (op->events & WAVEFORM_EVENT_HALF) {
+            w->half_period++;
+        }
+        if (op->events & WAVEFORM_EVENT_CYCLE) {
+            w->cycle++;
+        }
+        if ((op->events & WAVEFORM_EVENT_ELECTRODE) && electrode_list_count > 0) {
+            if (++w->electrode_index >= electrode_list_count) {
+                w->electrode_index = 0;
+            }
+        }
+
+        if (op->ticks > 0) {
+            w->ticks_left = op->ticks - 1;
+            w->value = waveformLevel(w->out_q16);
+            break;
+        }
+    }
+
+    return events;
+}
+
+// Advance the potential program by one LETIMER period
+static uint8_t waveformTick(waveform_state_t *w) {
+    if (w->ticks_left > 0) {
+        w->ticks_left--;
+        w->out_q16 += w->slope_q16;
+        if (w->sine_amp != 0) {
+            // Q15 sine times VDAC units is Q16 after one more doubling
+            w->phase = (w->phase + 1) & (WAVEFORM_SINE_STEPS - 1);
+            w->value = waveformLevel(w->out_q16 + w->sine_amp * waveform_sine_q15[w->phase] * 2);
+        } else {
+            w->value = waveformLevel(w->out_q16);
+        }
+        return 0;
+    }
+    if (w->finished) {
+        return 0;
+    }
+    return waveformEnter(w);
+}
+
+// Mirror a rendered playback half into the VDAC1 ring; both rings drain on the same PRS edges
+static void vdacRefFill(uint32_t *dst, const uint32_t *src) {
+  if (vdac_drive != VDAC_DRIVE_BIPOLAR) {
+    return;
+  }
+  for (uint32_t i = 0; i < VDAC_LDMA_WORDS_PER_HALF; i++) {
+    dst[i] = 4095 - src[i];
+  }
+}
+
+// Render the next count LETIMER periods of the program into a VDAC playback half
+static void waveformFill(waveform_state_t *w, uint32_t *dst, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        (void) waveformTick(w);
+        dst[i] = w->value;
+    }
+}
+
+// Start the timebase, IADC and potential program of the pre-phase or, once it is over, of the scan
+static void acquisitionStart(void)
+{
+    vdacOUT_offset = vdacOUT_start;
+
+    iadcSAMPLE_count = 0;
+    vdacOUT_count  = 0;
+    iadc_isFirstSample = true;
+    measurement_stop_requested = false;
+    measurement_complete = false;
+    measurement_active = true;
+    samples_in_current_pulse = 0;
+    pulseAccumulatorReset();
+    autorange_min_ch0 = ADC_FULL_SCALE_CODE;
+    autorange_max_ch0 = 0;
+    for (uint8_t e = 0; e < ELECTRODE_COUNT; e++) {
+        swv_reverse_valid[e] = false;
+    }
+    
+    // Initialize linear sweep variables
+    linear_sweep_timer_count = 0;
+    linear_sweep_current_voltage = vdacOUT_start;
+    
+    // Fit the IADC profile and sample rate, then derive step and pulse timing from the result
+    planAcquisition();
+    if (prephase_running) {
+        // The pre-phase keeps the IADC plan of the scan, its period only has to fit one conversion
+        prephase_period_ticks = timebaseRateTicks(prephase_rate);
+        if (prephase_period_ticks <= iadc_compare_ticks) {
+            prephase_period_ticks = iadc_compare_ticks + 1;
+        }
+    }
+
+    // Per-pulse streams only exist for SWV; DPV only ever sends the two means of each step and
+    // NPV / RPV one decimated record per pulse. The pre-phase is always decimated.
+    // Pack as many whole records per packet as fit
+    if (prephase_running) {
+        stream_active_mode = STREAM_MODE_DECIMATED;
+    } else if (operating_mode == 0) {
+        stream_active_mode = stream_mode;
+    } else if (operating_mode == 4) {
+        stream_active_mode = STREAM_MODE_SWV_DIFF;
+    } else if (operating_mode == 5 || operating_mode == 6) {
+        stream_active_mode = STREAM_MODE_DECIMATED;
+    } else if (operating_mode == 8) {
+        stream_active_mode = STREAM_MODE_EIS;
+    } else {
+        stream_active_mode = STREAM_MODE_RAW;
+    }
+    if (stream_active_mode == STREAM_MODE_DECIMATED) {
+        BLE_packetSize = BLE_packetSizeFor(BLE_DECIMATED_CHUNKSIZE);
+    } else if (stream_active_mode == STREAM_MODE_SWV_DIFF) {
+        BLE_packetSize = BLE_packetSizeFor(BLE_SWV_DIFF_CHUNKSIZE);
+    } else if (stream_active_mode == STREAM_MODE_EIS) {
+        BLE_packetSize = BLE_packetSizeFor(BLE_EIS_CHUNKSIZE);
+    } else if (pulseTimedMode()) {
+        BLE_packetSize = BLE_pulsePacketSize();
+    }
+    calculateLinearSweepStep();
+    calculatePulseTiming();
+    waveformPlan();
+    waveformReset(&waveform_live);
+    vdacOUT_value = waveform_live.value; // VDAC already sits at vdacOUT_start
+
+    if (prephase_running) {
+        timebasePeriodSet(prephase_period_ticks);
+    } else if (pulseTimedMode()) {
+        uint32_t periodTicks = pulseSlotTicks();
+        timebasePeriodSet(periodTicks);
+        planSampleWindow(periodTicks);
+    } else if (operating_mode == 1) {
+        BLE_packetSize = BLE_packetSizeFor(BLE_DATACHUNKSIZE);
+        // For linear sweep mode, set timer frequency to match sampling rate (same period as calculateLinearSweepStep)
+        timebasePeriodSet(timebaseRateTicks(linear_sweep_sample_rate));
+        // Set initial voltage for linear sweep
+        vdacOUT_value = vdacOUT_start;
+    } else if (operating_mode == 2 || operating_mode == 3) {
+        // For pulse mode and uploaded programs, use linear_sweep_sample_rate to set timer frequency
+        BLE_packetSize = BLE_packetSizeFor(BLE_DATACHUNKSIZE);
+        timebasePeriodSet(timebaseRateTicks(linear_sweep_sample_rate));
+        // Set initial voltage to start voltage
+        vdacOUT_value = vdacOUT_start;
+    } else if (operating_mode == 7) {
+        // The first period runs at vdacOUT_start, the first step starts at its underflow
+        BLE_packetSize = BLE_packetSizeFor(BLE_DATACHUNKSIZE);
+        chrono_index = 0;
+        timebasePeriodSet(chronoPeriodTicks(0));
+    } else if (operating_mode == 8) {
+        // The first period samples the bias, the first frequency starts at its end
+        eis_point     = 0;
+        eis_acc_point = 0;
+        eis_acc_count = 0;
+        eis_results_done   = 0;
+        eis_results_packed = 0;
+        timebasePeriodSet((eis_frequency_count > 0) ? eis_point_ticks[0] : timebase_hz);
+    }
+    chrono_active = !prephase_running && (operating_mode == 7);
+    eis_active    = !prephase_running && (operating_mode == 8);
+    if (prephase_running || !pulseTimedMode()) {
+        planSampleWindow(0);
+    }
+    if (prephase_running && prephase_step_count == 0) {
+        iadc_half_skip = iadcSAMPLESperPULSE; // The plain hold before the trial is not sampled at all
+    }
+    
+    // Select how scan results leave the IADC FIFO
+    if (iadc_transfer_mode == IADC_TRANSFER_LDMA) {
+        IADC_disableInt(IADC0, IADC_IEN_SCANTABLEDONE);
+        iadcLdmaStart();
+    } else {
+        IADC_clearInt(IADC0, IADC_IEN_SCANTABLEDONE);
+        IADC_enableInt(IADC0, IADC_IEN_SCANTABLEDONE);
+    }
+
+    // Select what starts each scan; a PRS trigger leaves the scan queue armed for the whole run
+    adc_trigger_source = adc_trigger_config & ADC_TRIGGER_SOURCE_MASK;
+    initIADCScan();
+    iadc_prs_armed = (adc_trigger_source == ADC_TRIGGER_PRS) && sampleInWindow(1);
+    if (iadc_prs_armed) {
+        IADC_command(IADC0, iadcCmdStartScan);
+    }
+    jitterProbeStart();
+
+    // Hand the potential program to the LDMA before the first underflow needs it
+    // The pre-phase is slow and may float the VDAC, so software writes it
+    vdac_playback_active = prephase_running ? VDAC_PLAYBACK_CPU : vdac_playback;
+    vdacPlaybackStart();
+
+    timebaseStart();
+
+#if RUN_MODE == 0
+    GPIO_PinOutClear(LED_OUT_PORT, LED_OUT_PIN);
+#endif
+}
 
 void startNewMeasurement(void)
 {
+  // The queue reset below would discard a capture still being uploaded, so refuse the start until the
+  // host has the Run Experiment 0 that follows the last packet, and show the real state to a read
+  if (capture_policy == CAPTURE_POLICY_UPLOAD && !measurement_active && !prephase_running
+      && !ble_ring_is_empty(&BLE_queue)) {
+    sl_bt_gatt_server_write_attribute_value(gattdb_RUN_EXPERIMENT, 0, sizeof(BLE_value_runExperiment), &BLE_value_runExperiment);
+    return;
+  }
 
 // Drain any pending IADC scan FIFO results to avoid processing stale samples
   while (IADC_getScanFifoCnt(IADC0) > 0) {
     (void) IADC_pullScanFifoResult(IADC0);
   }
+
+  // Electrode list for the round-robin (first electrode, or electrode_channel when off)
+  if (!measurement_active) {
+    planElectrodeScan();
+    planGainAutorange();
+  }
+
   #if RUN_MODE == 1
   GPIO_PinModeSet(EN_1_8_PORT, EN_1_8_PIN, gpioModePushPull, 1);
   GPIO_PinModeSet(EN_Vplus_PORT, EN_Vplus_PIN, gpioModePushPull, 1);
 
-  // Set electrode channel GPIO pins based on electrode_channel value (0-7)
+  // Set electrode channel GPIO pins based on electrode_channel value (0-7), or the first electrode of the round-robin
   // Uses 3-bit binary: C_A2 (bit 2), C_A1 (bit 1), C_A0 (bit 0)
-  GPIO_PinModeSet(C_A0_PORT, C_A0_PIN, gpioModePushPull, electrode_channel & 1);
-  GPIO_PinModeSet(C_A1_PORT, C_A1_PIN, gpioModePushPull, (electrode_channel >> 1) & 1);
-  GPIO_PinModeSet(C_A2_PORT, C_A2_PIN, gpioModePushPull, (electrode_channel >> 2) & 1);
+  GPIO_PinModeSet(C_A0_PORT, C_A0_PIN, gpioModePushPull, electrode_active & 1);
+  GPIO_PinModeSet(C_A1_PORT, C_A1_PIN, gpioModePushPull, (electrode_active >> 1) & 1);
+  GPIO_PinModeSet(C_A2_PORT, C_A2_PIN, gpioModePushPull, (electrode_active >> 2) & 1);
 
-  // Set gain channel GPIO pins based on gain_channel value (0-3)
+  // Set gain channel GPIO pins based on gain_channel value (0-3), the autoranger starts from it too
   // 0: F_A1=0, F_A0=0 (00 binary) - bottom (100k||10nF)
   // 1: F_A1=0, F_A0=1 (01 binary) - top (200k||1000pF)
   // 2: F_A1=1, F_A0=0 (10 binary) - middle bottom (8.22k||100nF)
   // 3: F_A1=1, F_A0=1 (11 binary) - middle top (20k||47nF)
-  GPIO_PinModeSet(F_A1_PORT, F_A1_PIN, gpioModePushPull, (gain_channel >> 1) & 1);
-  GPIO_PinModeSet(F_A0_PORT, F_A0_PIN, gpioModePushPull, gain_channel & 1);
+  GPIO_PinModeSet(F_A1_PORT, F_A1_PIN, gpioModePushPull, (gain_active >> 1) & 1);
+  GPIO_PinModeSet(F_A0_PORT, F_A0_PIN, gpioModePushPull, gain_active & 1);
 
 #elif RUN_MODE == 2
   GPIO_PinModeSet(EN_PORT, EN_PIN, gpioModePushPull, 1);
 
-  // Set electrode channel GPIO pins based on electrode_channel value (0-7)
+  // Set electrode channel GPIO pins based on electrode_channel value (0-7), or the first electrode of the round-robin
   // Uses 3-bit binary: C_A2 (bit 2), C_A1 (bit 1), C_A0 (bit 0)
-  GPIO_PinModeSet(C_A0_PORT, C_A0_PIN, gpioModePushPull, electrode_channel & 1);
-  GPIO_PinModeSet(C_A1_PORT, C_A1_PIN, gpioModePushPull, (electrode_channel >> 1) & 1);
-  GPIO_PinModeSet(C_A2_PORT, C_A2_PIN, gpioModePushPull, (electrode_channel >> 2) & 1);
+  GPIO_PinModeSet(C_A0_PORT, C_A0_PIN, gpioModePushPull, electrode_active & 1);
+  GPIO_PinModeSet(C_A1_PORT, C_A1_PIN, gpioModePushPull, (electrode_active >> 1) & 1);
+  GPIO_PinModeSet(C_A2_PORT, C_A2_PIN, gpioModePushPull, (electrode_active >> 2) & 1);
 
-  // Set gain channel GPIO pins based on gain_channel value (0-3)
+  // Set gain channel GPIO pins based on gain_channel value (0-3), the autoranger starts from it too
   // 0: F_A1=0, F_A0=0 (00 binary) - bottom (20k)
   // 1: F_A1=0, F_A0=1 (01 binary) - top (4.7k)
   // 2: F_A1=1, F_A0=0 (10 binary) - middle bottom (12k)
   // 3: F_A1=1, F_A0=1 (11 binary) - middle top (8.2k)
-  GPIO_PinModeSet(F_A1_PORT, F_A1_PIN, gpioModePushPull, (gain_channel >> 1) & 1);
-  GPIO_PinModeSet(F_A0_PORT, F_A0_PIN, gpioModePushPull, gain_channel & 1);
+  GPIO_PinModeSet(F_A1_PORT, F_A1_PIN, gpioModePushPull, (gain_active >> 1) & 1);
+  GPIO_PinModeSet(F_A0_PORT, F_A0_PIN, gpioModePushPull, gain_active & 1);
 #endif
 
-//  VDAC_ChannelOutputSet(VDAC_REF_ID, VDAC_REF_CH, vdacOUT_ref);
-  VDAC_ChannelOutputSet(VDAC_SIG_ID, VDAC_SIG_CH, vdacOUT_start);
+  // VDAC1 only drives the reference electrode in bipolar mode, otherwise it leaves it floating
+  VDAC_Enable(VDAC_REF_ID, VDAC_REF_CH, vdac_drive == VDAC_DRIVE_BIPOLAR);
+  vdacOutputSet(vdacOUT_start);
 
 //  sl_sleeptimer_delay_millisecond(30000); // Delay for X milliseconds
-  sl_sleeptimer_delay_millisecond(time_before_trial * 1000); // Configurable delay before trial starts
+//  sl_sleeptimer_delay_millisecond(time_before_trial * 1000); // Configurable delay before trial starts
 
 //  VDAC_ChannelOutputSet(VDAC_REF_ID, VDAC_REF_CH, vdacOUT_ref);
 
   if (vdacOUT_offset == 0xFFFF) {
-      vdacOUT_offset = vdacOUT_start;
-
-      iadcSAMPLE_count = 0;
-      vdacOUT_count  = 0;
-      iadc_isFirstSample = true;
-      measurement_stop_requested = false;
-      measurement_complete = false;
-      measurement_active = true;
-      samples_in_current_pulse = 0;
       BLE_result_counter = 0; // Reset result counter for new measurement
       BLE_dropped_packets = 0; // Reset dropped packet counter
+      BLE_retried_packets = 0;
+      BLE_overwritten_packets = 0;
+      BLE_head_attempts = 0;
       BLE_transmission_busy = false; // Reset transmission busy flag
-      // Reset queue
-      BLE_queue_head = 0;
-      BLE_queue_tail = 0;
-      BLE_queue_count = 0;
-      BLE_value_runExperiment = 1;
-      BLE_notify_runExperiment = true;
-      
-      // Initialize linear sweep variables
-      linear_sweep_timer_count = 0;
-      linear_sweep_current_voltage = vdacOUT_start;
-      linear_sweep_direction_forward = true; // Always start going forward
-      
-      // Calculate linear sweep step and pulse timing
-      calculateLinearSweepStep();
-      calculatePulseTiming();
-
-      if (operating_mode == 0) {
-          uint32_t topValue = (int) ((double) pulse_width_ms * 32.768 / iadcSAMPLESperPULSE);
-          LETIMER_TopSet(LETIMER0, topValue);
-          LETIMER_CounterSet(LETIMER0, topValue);
-      } else if (operating_mode == 1) {
-          BLE_packetSize = 200;
-          // For linear sweep mode, set timer frequency to match sampling rate
-          uint32_t topValue = (uint32_t)(32768.0 / linear_sweep_sample_rate);
-          LETIMER_TopSet(LETIMER0, topValue);
-          LETIMER_CounterSet(LETIMER0, topValue);
-          // Set initial voltage for linear sweep
-          vdacOUT_value = vdacOUT_start;
-      } else if (operating_mode == 2) {
-          // For pulse mode, use linear_sweep_sample_rate to set timer frequency
-          BLE_packetSize = 200;
-          uint32_t topValue = (uint32_t)(32768.0 / linear_sweep_sample_rate);
-          LETIMER_TopSet(LETIMER0, topValue);
-          LETIMER_CounterSet(LETIMER0, topValue);
-          // Initialize pulse mode variables
-          pulse_timer_count = 0;
-          pulse_state = 0; // Start in before_pulse state
-          vdacOUT_value = vdacOUT_start; // Set initial voltage to start voltage
+      // Reset queue; states still waiting for their packets are due at once
+      ble_ring_init(&BLE_queue, BLE_queue.slots, BLE_queue.capacity);
+      for (uint8_t i = 0; i < run_state_count; i++) {
+          run_state_queue[i].after = 0;
       }
-      
-      LETIMER_Enable(LETIMER0, true); // Start the timer
+      BLE_reserve_packet();
 
-#if RUN_MODE == 0
-      GPIO_PinOutClear(LED_OUT_PORT, LED_OUT_PIN);
-#endif
+      // The pre-phase replaces the blocking delay before the trial, the scan follows from app_process_action
+      prephase_running = (prephase_step_count > 0) || (time_before_trial > 0);
+      runStateNotify(prephase_running ? 2 : 1);
+      acquisitionStart();
+  } // else { // Test is already running, do nothing
+}
+
+// Stop the timebase, IADC and potential program and send what is left of a decimated stream
+static void acquisitionStop(void)
+{
+  // Disarm a PRS-triggered scan so LETIMER edges no longer start conversions
+  if (adc_trigger_source == ADC_TRIGGER_PRS) {
+    IADC_command(IADC0, iadcCmdStopScan);
+    iadc_prs_armed = false;
+  }
+  jitterProbeStop();
+
+  // Collect the scans still sitting in the active LDMA half
+  iadcLdmaStop();
+  vdacPlaybackStop();
+  timebaseStop();
+  vdacSignalConnect(true);
+  measurement_active = false;
+  eisProcessResults();
+
+  // Decimated records are sparse, so do not leave the tail of the scan in a partial packet
+  if (stream_active_mode != STREAM_MODE_RAW && BLE_result_counter > 0) {
+    CORE_DECLARE_IRQ_STATE;
+    CORE_ENTER_CRITICAL();
+    BLE_flush_packet(BLE_result_counter);
+    CORE_EXIT_CRITICAL();
+  }
+}
+
+// The pre-phase ran out: start the scan from vdacOUT_start, the stream and the queue carry on
+static void prephaseFinish(void)
+{
+  acquisitionStop();
+  prephase_running = false;
+  vdacOutputSet(vdacOUT_start);
+
+  // Announced once the last pre-phase packet, flushed by acquisitionStop, is out
+  runStateNotify(1);
+  acquisitionStart();
+}
+
+void stopThisMeasurement() {
+  acquisitionStop();
+  BLE_report_link_stats();
+  runStateNotify(0);
+
+  // Send any remaining partial data before stopping
+  // if (BLE_result_counter > 0) {
+  //   // Store the final packet size for send_result_notification to use
+  //   BLE_final_packet_size = BLE_result_counter;
+  //   BLE_result_counter = 0; // Reset counter
+  //   BLE_result_select = !BLE_result_select; // Switch buffers
+  //   BLE_notify_result = true; // Trigger notification with partial data
+    
+  //   // Wait a bit to ensure the notification is sent
+  //   sl_sleeptimer_delay_millisecond(50);
+    
+  //   // Reset final packet size
+  //   BLE_final_packet_size = 0;
+  // }
+
+  vdacOUT_value = vdacOUT_ref;
+  vdacOutputSet(vdacOUT_value);
+  vdacOUT_offset = 0xFFFF;
+
+  // Configurable delay after trial ends
+  // sl_sleeptimer_delay_millisecond(time_after_trial * 1000);
+
+
+  #if RUN_MODE == 0
+    GPIO_PinOutSet(LED_OUT_PORT, LED_OUT_PIN);
+
+  #elif RUN_MODE == 1
+    GPIO_PinModeSet(EN_1_8_PORT, EN_1_8_PIN, gpioModePushPull, 1);
+    GPIO_PinModeSet(EN_Vplus_PORT, EN_Vplus_PIN, gpioModePushPull, 1);
+
+  #elif RUN_MODE == 2
+    GPIO_PinModeSet(EN_PORT, EN_PIN, gpioModePushPull, 1);
+  #endif
+}
+
+// Queue management functions, the ring itself is in ble_ring.h
+
+// Point BLE_current_packet at the slot after the queued packets, the records are packed straight into it
+static void BLE_reserve_packet(void) {
+    if (capture_policy == CAPTURE_POLICY_DROP_OLDEST) {
+        // The tail stays with app_process_action, which skips the overwritten packet before its next send
+        bool overwrote;
+        BLE_current_packet = ble_ring_reserve_overwrite(&BLE_queue, &overwrote);
+        if (overwrote) {
+            BLE_overwritten_packets++;
+        }
+    } else {
+        BLE_current_packet = ble_ring_reserve(&BLE_queue);
+    }
+    if (BLE_current_packet == NULL) {
+        BLE_current_packet = BLE_discard_packet; // Queue is full, or the oldest packet is being sent
+    }
+}
+
+// Queue the reserved slot holding size bytes, false when it had to be packed into BLE_discard_packet
+static bool BLE_commit_packet(uint8_t size) {
+    if (BLE_current_packet == BLE_discard_packet) {
+        BLE_dropped_packets++;
+        return false;
+    }
+    ble_ring_commit(&BLE_queue, size);
+    return true; // Successfully enqueued
+}
+
+static void BLE_pop_packet(void) {
+    ble_ring_pop(&BLE_queue);
+    BLE_head_attempts = 0;
+}
+
+// Publish the loss counters of the current measurement: retried, dropped, overwritten packets
+static void BLE_report_link_stats(void) {
+    uint32_t link_stats[3];
+    link_stats[0] = BLE_retried_packets;
+    link_stats[1] = BLE_dropped_packets;
+    link_stats[2] = BLE_overwritten_packets;
+    sl_bt_gatt_server_write_attribute_value(gattdb_LINK_STATS, 0, sizeof(link_stats), (uint8_t *) link_stats);
+}
+
+// Move the ring into the largest power of two of packet slots that fits the free heap, less a reserve
+// for the stack. Called once at boot, before any measurement can use the ring.
+static void captureBufferInit(void)
+{
+  sl_memory_heap_info_t heap_info;
+  if (sl_memory_get_heap_info(&heap_info) != SL_STATUS_OK
+      || heap_info.free_block_largest_size <= CAPTURE_HEAP_RESERVE) {
+    return; // Keep the static slots
+  }
+
+  uint32_t slots    = (heap_info.free_block_largest_size - CAPTURE_HEAP_RESERVE) / sizeof(ble_packet_t);
+  uint32_t capacity = BLE_QUEUE_SIZE;
+  while (capacity * 2 <= slots) {
+    capacity *= 2;
+  }
+  if (capacity == BLE_QUEUE_SIZE) {
+    return;
+  }
+
+  void *capture;
+  if (sl_memory_alloc(capacity * sizeof(ble_packet_t), BLOCK_TYPE_LONG_TERM, &capture) != SL_STATUS_OK) {
+    return;
+  }
+  ble_ring_init(&BLE_queue, (ble_packet_t *)capture, capacity);
+}
+
+// Queue a Run Experiment notification behind the packets queued so far (main loop only)
+static void runStateNotify(uint8_t value)
+{
+  BLE_value_runExperiment = value;
+  if (run_state_count == RUN_STATE_QUEUE_SIZE) {
+    run_state_count--; // Keep the newest state
+  }
+  run_state_queue[run_state_count].value = value;
+  run_state_queue[run_state_count].after = BLE_queue.head;
+  run_state_count++;
+}
+
+// Send the states whose packets are all out; false while one of them is still refused
+static bool runStateSendDue(void)
+{
+  while (run_state_count > 0 && (int32_t)(BLE_queue.tail - run_state_queue[0].after) >= 0) {
+    if (run_state_queue[0].value == 0) {
+      BLE_report_link_stats(); // Final now that the measurement's packets are all out
+    }
+    if (send_runExperiment_notification(run_state_queue[0].value) != SL_STATUS_OK) {
+      return false; // Retry next pass, no packet may overtake it
+    }
+    run_state_count--;
+    memmove(&run_state_queue[0], &run_state_queue[1], run_state_count * sizeof(run_state_t));
+  }
+  return true;
+}
+
+// Enqueue the current packet (full, or partial when flushing at the end of a measurement)
+static void BLE_flush_packet(uint8_t size)
+{
+  // app_process_action sends whatever the ring holds
+  (void)BLE_commit_packet(size);
+  // Reset counter and reserve the slot for the next packet regardless of enqueue success
+  BLE_result_counter = 0;
+  BLE_reserve_packet();
+}
+
+// Count the record just written at BLE_result_counter and enqueue the packet once it is full
+static void BLE_commit_record(uint8_t record_size)
+{
+  BLE_result_counter += record_size;
+  if (BLE_result_counter + record_size > BLE_packetSize) {
+      // Packet is complete, enqueue it
+      BLE_flush_packet(BLE_result_counter);
+  }
+}
+
+// Write a 24-bit little-endian field into the current packet
+static void BLE_put_u24(uint8_t offset, uint32_t value)
+{
+  BLE_current_packet[BLE_result_counter+offset+0] = ( value & 0x0000FF)      ;
+  BLE_current_packet[BLE_result_counter+offset+1] = ( value & 0x00FF00) >>  8;
+  BLE_current_packet[BLE_result_counter+offset+2] = ( value & 0xFF0000) >> 16;
+}
+
+// Write a 16-bit little-endian field into the current packet
+static void BLE_put_u16(uint8_t offset, uint16_t value)
+{
+  BLE_current_packet[BLE_result_counter+offset+0] = ( value & 0x00FF)      ;
+  BLE_current_packet[BLE_result_counter+offset+1] = ( value & 0xFF00) >>  8;
+}
+
+// Pack one sample record into the current packet buffer and enqueue the packet once it is full
+static void BLE_pack_sample(uint32_t result_channel0, uint32_t result_channel1, uint16_t vdac_value, uint16_t sample_count)
+{
+  BLE_put_u24(0, result_channel0);
+  BLE_put_u24(3, result_channel1);
+  BLE_put_u16(6, vdac_value);
+  BLE_put_u16(8, sample_count);
+
+  BLE_commit_record(BLE_DATACHUNKSIZE);
+}
+
+// Clear the half-period accumulator
+static void pulseAccumulatorReset(void)
+{
+  pulse_sum_ch0 = 0;
+  pulse_sum_ch1 = 0;
+  pulse_min_ch0 = 0xFFFFF;
+  pulse_max_ch0 = 0;
+  samples_in_current_pulse = 0;
+}
 
-  } // else { // Test is already running, do nothing
+// Rounded mean of the accumulated samples (call with samples_in_current_pulse > 0)
+static uint32_t pulseMean(uint64_t sum)
+{
+  uint32_t n = samples_in_current_pulse;
+  return (uint32_t)((sum + n / 2) / n);
 }
 
-void stopThisMeasurement() {
-  BLE_value_runExperiment  = 0;
-  BLE_notify_runExperiment = true;
-  measurement_active = false;
+// Pack one decimated half-period record from the accumulator
+static void BLE_pack_pulse(uint16_t vdac_value, uint16_t pulse_index, uint8_t electrode, uint8_t gain)
+{
+  uint32_t n = samples_in_current_pulse;
+
+  BLE_put_u24( 0, pulseMean(pulse_sum_ch0));
+  BLE_put_u24( 3, pulse_min_ch0);
+  BLE_put_u24( 6, pulse_max_ch0);
+  BLE_put_u24( 9, pulseMean(pulse_sum_ch1));
+  BLE_put_u16(12, vdac_value);
+  BLE_put_u16(14, pulse_index);
+  BLE_current_packet[BLE_result_counter+16] = (n > 0xFF) ? 0xFF : n;
+  BLE_current_packet[BLE_result_counter+17] = ((electrode & 0x0F) << 4) | (gain & 0x0F);
+
+  BLE_commit_record(BLE_DECIMATED_CHUNKSIZE);
+}
 
-  // Send any remaining partial data before stopping
-  // if (BLE_result_counter > 0) {
-  //   // Store the final packet size for send_result_notification to use
-  //   BLE_final_packet_size = BLE_result_counter;
-  //   BLE_result_counter = 0; // Reset counter
-  //   BLE_result_select = !BLE_result_select; // Switch buffers
-  //   BLE_notify_result = true; // Trigger notification with partial data
-    
-  //   // Wait a bit to ensure the notification is sent
-  //   sl_sleeptimer_delay_millisecond(50);
-    
-  //   // Reset final packet size
-  //   BLE_final_packet_size = 0;
-  // }
+// Pair SWV half-periods by vdacOUT_count parity and pack one difference record per staircase step.
+// half_period is the vdacOUT_count that was active while the accumulated samples were taken, as
+// tagged by the LETIMER, so the LDMA path pairs exactly like the interrupt path. Pairs are kept per
+// electrode because the round-robin can interleave the half-periods of several electrodes.
+static void BLE_pack_swv_diff(uint16_t vdac_value, uint32_t half_period, uint8_t electrode, uint8_t gain)
+{
+  uint32_t mean = pulseMean(pulse_sum_ch0);
+  electrode &= ELECTRODE_COUNT - 1;
+
+  if (half_period == 0) {
+    // Initial hold at vdacOUT_start before the first pulse, not part of any step
+    swv_reverse_valid[electrode] = false;
+  } else if ((half_period & 0x1) == 0) {
+    // Even: offset - pulse, first half of a step
+    swv_reverse_valid[electrode] = true;
+    swv_reverse_mean[electrode]  = mean;
+    swv_reverse_vdac[electrode]  = vdac_value;
+  } else if (swv_reverse_valid[electrode]) {
+    // Odd: offset + pulse on the same offset, completes the step
+    int32_t  delta_current  = (int32_t)mean - (int32_t)swv_reverse_mean[electrode];
+    uint16_t step_potential = (uint16_t)(((uint32_t)vdac_value + swv_reverse_vdac[electrode]) / 2); // vdacOUT_offset
+
+    BLE_put_u16( 0, step_potential);
+    BLE_put_u24( 2, mean);
+    BLE_put_u24( 5, swv_reverse_mean[electrode]);
+    BLE_put_u24( 8, (uint32_t)delta_current & 0xFFFFFF);
+    BLE_put_u16(11, (uint16_t)(half_period / 2));
+    BLE_current_packet[BLE_result_counter+13] = ((electrode & 0x0F) << 4) | (gain & 0x0F);
+
+    BLE_commit_record(BLE_SWV_DIFF_CHUNKSIZE);
+    swv_reverse_valid[electrode] = false;
+  }
+}
 
-  vdacOUT_value = vdacOUT_ref;
-  VDAC_ChannelOutputSet(VDAC_SIG_ID, VDAC_SIG_CH, vdacOUT_value);
-  vdacOUT_offset = 0xFFFF;
+// Turn the lock-in sums of one frequency into |Z| and phase and pack one impedance record.
+// x_k = A sin(2 pi k / N + phi) gives sum(x sin) = A cos(phi) M / 2 and sum(x cos) = A sin(phi) M / 2.
+// Runs in app_process_action; only the packing itself masks the acquisition interrupt.
+static void BLE_pack_eis(uint32_t point, int64_t acc_i, int64_t acc_q, uint8_t gain)
+{
+  uint32_t samples = (uint32_t)eis_periods * WAVEFORM_SINE_STEPS;
+  float    sum_i   = (float)acc_i / 32768.0f;
+  float    sum_q   = (float)acc_q / 32768.0f;
+  float    amp_codes = 2.0f * sqrtf(sum_i * sum_i + sum_q * sum_q) / (float)samples;
+
+  // The VDAC holds each step for a whole tick: its fundamental is sinc(pi / N) smaller and half a
+  // tick late, while the scan starts iadc_compare_ticks before the end of the tick
+  float ticks     = (float)eis_point_ticks[point];
+  float half_step = EIS_PI / WAVEFORM_SINE_STEPS;
+  float phase_i   = atan2f(sum_q, sum_i) - 2.0f * half_step * (0.5f - (float)iadc_compare_ticks / ticks);
+#if EIS_TIA_INVERTING
+  phase_i -= EIS_PI;
+#endif
 
-  // Configurable delay after trial ends
-  // sl_sleeptimer_delay_millisecond(time_after_trial * 1000);
+  // |Z| = V / I with V the excitation amplitude and I = TIA amplitude / feedback resistor
+  float volts   = (float)eis_amplitude * (float)VDAC_REF_VOLTAGE / 4096.0f * sinf(half_step) / half_step;
+  if (vdac_drive == VDAC_DRIVE_BIPOLAR) {
+    volts *= 2.0f;
+  }
+  float current = amp_codes * (float)ADC_REF_VOLTAGE / (float)ADC_FULL_SCALE_CODE / (float)gain_resistor_ohms[gain & (GAIN_COUNT - 1)];
+  float z_ohms  = (current > 0.0f) ? volts / current : INFINITY;
+  float phase_z = -phase_i;
+  while (phase_z >  EIS_PI) phase_z -= 2.0f * EIS_PI;
+  while (phase_z < -EIS_PI) phase_z += 2.0f * EIS_PI;
+
+  uint32_t frequency_mhz = (uint32_t)((uint64_t)timebase_hz * 1000 / ((uint64_t)WAVEFORM_SINE_STEPS * eis_point_ticks[point]));
+  uint32_t z_bits;
+  memcpy(&z_bits, &z_ohms, sizeof(z_bits));
+  uint32_t amplitude = (amp_codes > (float)ADC_FULL_SCALE_CODE) ? ADC_FULL_SCALE_CODE : (uint32_t)(amp_codes + 0.5f);
+  uint16_t phase_cdeg = (uint16_t)(int16_t)lroundf(phase_z * 18000.0f / EIS_PI);
+
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
+  BLE_put_u16( 0, frequency_mhz & 0xFFFF);
+  BLE_put_u16( 2, frequency_mhz >> 16);
+  BLE_put_u16( 4, z_bits & 0xFFFF);
+  BLE_put_u16( 6, z_bits >> 16);
+  BLE_put_u16( 8, phase_cdeg);
+  BLE_put_u24(10, amplitude);
+  BLE_current_packet[BLE_result_counter+13] = (uint8_t)point;
+  BLE_current_packet[BLE_result_counter+14] = gain & 0x0F;
+
+  BLE_commit_record(BLE_EIS_CHUNKSIZE);
+  CORE_EXIT_CRITICAL();
+}
 
+// Pack the frequencies the interrupt has finished since the last call
+static void eisProcessResults(void)
+{
+  while (eis_results_packed != eis_results_done) {
+    // Read the sums only after seeing the count that published them
+    __DMB();
+    uint8_t point = eis_results_packed++;
+    BLE_pack_eis(point, eis_result_i[point], eis_result_q[point], eis_result_gain[point]);
+  }
+}
 
-  #if RUN_MODE == 0
-    GPIO_PinOutSet(LED_OUT_PORT, LED_OUT_PIN);
+// Lock-in demodulation of one ch0 sample against the sine its frequency was excited with.
+// Whole periods cancel the TIA bias, so the raw code goes in as is; the 64-bit multiply-accumulates
+// map onto the Cortex-M33 SMLAL instruction.
+static void eisAccumulate(uint32_t result_channel0, const iadc_sample_tag_t *tag)
+{
+  if (tag->half_period != eis_acc_point) {
+    // The first frequency is half-period 1, the bias sample before it is half-period 0
+    eis_acc_point = tag->half_period;
+    eis_acc_i     = 0;
+    eis_acc_q     = 0;
+    eis_acc_count = 0;
+  }
 
-  #elif RUN_MODE == 1
-    GPIO_PinModeSet(EN_1_8_PORT, EN_1_8_PIN, gpioModePushPull, 1);
-    GPIO_PinModeSet(EN_Vplus_PORT, EN_Vplus_PIN, gpioModePushPull, 1);
+  uint32_t index  = eis_acc_count++;
+  uint32_t settle = EIS_SETTLE_PERIODS * WAVEFORM_SINE_STEPS;
+  uint32_t total  = settle + (uint32_t)eis_periods * WAVEFORM_SINE_STEPS;
+  if (eis_acc_point == 0 || index < settle || index >= total) {
+    return;
+  }
 
-  #elif RUN_MODE == 2
-    GPIO_PinModeSet(EN_PORT, EN_PIN, gpioModePushPull, 1);
-  #endif
+  int32_t x = (int32_t)result_channel0;
+  eis_acc_i += (int64_t)x * waveform_sine_q15[tag->phase];
+  eis_acc_q += (int64_t)x * waveform_sine_q15[(tag->phase + WAVEFORM_SINE_STEPS / 4) & (WAVEFORM_SINE_STEPS - 1)];
+
+  // Hand the sums over, each frequency finishes once and in order
+  uint32_t point = eis_acc_point - 1;
+  if (index + 1 == total && point < EIS_MAX_FREQUENCIES) {
+    eis_result_i[point]    = eis_acc_i;
+    eis_result_q[point]    = eis_acc_q;
+    eis_result_gain[point] = tag->gain;
+    __DMB();
+    eis_results_done = point + 1;
+  }
 }
 
-// Queue management functions
-static bool BLE_queue_is_full(void) {
-    return BLE_queue_count >= BLE_QUEUE_SIZE;
-}
+// Signal completion once a stop was requested and the current pulse has all of its samples
+static void checkMeasurementStop(void)
+{
+  // Decimated streams already emitted the last complete half-period; the rest is the final hold
+  if (measurement_stop_requested && stream_active_mode != STREAM_MODE_RAW) {
+    measurement_complete = true;
+    measurement_stop_requested = false;
+    samples_in_current_pulse = 0;
+  }
 
-static bool BLE_queue_is_empty(void) {
-    return BLE_queue_count == 0;
+  if (measurement_stop_requested && (samples_in_current_pulse >= iadcSAMPLESperPULSE)) {
+    // All samples for the current pulse have been collected, safe to signal completion
+    measurement_complete = true;
+    measurement_stop_requested = false;
+    samples_in_current_pulse = 0;
+  }
 }
 
-static bool BLE_enqueue_packet(uint8_t *data, uint8_t size) {
-    if (BLE_queue_is_full()) {
-        BLE_dropped_packets++;
-        return false; // Queue is full
-    }
-    
-    // Copy data to queue
-    for (int i = 0; i < size && i < BLE_MAX_PACKET_SIZE; i++) {
-        BLE_packet_queue[BLE_queue_head].data[i] = data[i];
+// Route one completed scan to the active stream format (shared by the interrupt and LDMA paths)
+static void iadcHandleSample(uint32_t result_channel0, uint32_t result_channel1, const iadc_sample_tag_t *tag)
+{
+  uint32_t sample_count = tag->sample_count;
+
+  // Increment samples in current pulse counter
+  samples_in_current_pulse++;
+
+  if (gain_autorange_active) {
+    if (result_channel0 < autorange_min_ch0) autorange_min_ch0 = result_channel0;
+    if (result_channel0 > autorange_max_ch0) autorange_max_ch0 = result_channel0;
+    if ((sample_count % iadcSAMPLESperPULSE) == 0) {
+      autorangeHalfPeriod(tag->electrode, tag->gain);
     }
-    BLE_packet_queue[BLE_queue_head].size = size;
-    
-    // Update head pointer
-    BLE_queue_head = (BLE_queue_head + 1) % BLE_QUEUE_SIZE;
-    BLE_queue_count++;
-    
-    return true; // Successfully enqueued
-}
+  }
 
-static bool BLE_dequeue_packet(uint8_t *data, uint8_t *size) {
-    if (BLE_queue_is_empty()) {
-        return false; // Queue is empty
+  if (stream_active_mode == STREAM_MODE_EIS) {
+    eisAccumulate(result_channel0, tag);
+  } else if (stream_active_mode != STREAM_MODE_RAW) {
+    pulse_sum_ch0 += result_channel0;
+    pulse_sum_ch1 += result_channel1;
+    if (result_channel0 < pulse_min_ch0) pulse_min_ch0 = result_channel0;
+    if (result_channel0 > pulse_max_ch0) pulse_max_ch0 = result_channel0;
+
+    // The last sample of a half-period is taken right before the underflow that steps the VDAC
+    if ((sample_count % iadcSAMPLESperPULSE) == 0) {
+      if (stream_active_mode == STREAM_MODE_DECIMATED) {
+        BLE_pack_pulse(tag->vdac_value, sample_count / iadcSAMPLESperPULSE, tag->electrode, tag->gain);
+      } else {
+        BLE_pack_swv_diff(tag->vdac_value, tag->half_period, tag->electrode, tag->gain);
+      }
+      pulseAccumulatorReset();
     }
-    
-    // Copy data from queue
-    *size = BLE_packet_queue[BLE_queue_tail].size;
-    for (int i = 0; i < *size; i++) {
-        data[i] = BLE_packet_queue[BLE_queue_tail].data[i];
+  } else {
+    // Round-robin tags the electrode in the unused upper nibble of the 20-bit ch0 field
+    if (electrode_scan_active) {
+      result_channel0 |= (uint32_t)(tag->electrode & 0x0F) << 20;
     }
-    
-    // Update tail pointer
-    BLE_queue_tail = (BLE_queue_tail + 1) % BLE_QUEUE_SIZE;
-    BLE_queue_count--;
-    
-    return true; // Successfully dequeued
+    // Autoranging tags the gain in the unused upper nibble of the 20-bit ch1 field
+    if (gain_autorange_active) {
+      result_channel1 |= (uint32_t)(tag->gain & 0x0F) << 20;
+    }
+    // Multi-cycle programs tag the cycle index above the 12-bit VDAC code
+    uint16_t vdac_field = tag->vdac_value;
+    if (waveform_cycle_tagged) {
+        vdac_field |= (uint16_t)(tag->cycle & 0x0F) << 12;
+    }
+    BLE_pack_sample(result_channel0, result_channel1, vdac_field, sample_count);
+  }
+
+  // Check if we need to stop measurement after completing the current pulse
+  checkMeasurementStop();
 }
 
 void IADC_IRQHandler(void)
@@ -573,10 +2530,10 @@ void IADC_IRQHandler(void)
               result_channel1 = ((uint32_t) sample.data) & 0xFFFFF; // 20 bits
           }
         }
-    IADC_command(IADC0, iadcCmdStopScan);
-
-    // // Increment samples in current pulse counter
-    samples_in_current_pulse++;
+    if (adc_trigger_source == ADC_TRIGGER_SOFTWARE) {
+      // A PRS-triggered scan queue must stay armed for the next LETIMER edge
+      IADC_command(IADC0, iadcCmdStopScan);
+    }
 
     // // While both channels have not been received and FIFO has data
     // while (!(ch0_received && ch1_received) && IADC_getScanFifoCnt(IADC0)) {
@@ -606,37 +2563,8 @@ void IADC_IRQHandler(void)
       last_processed_count = iadcSAMPLE_count;
 
       // Construct Packet in current packet buffer
-      BLE_current_packet[BLE_result_counter+0] = ( result_channel0 & 0x0000FF)      ;
-      BLE_current_packet[BLE_result_counter+1] = ( result_channel0 & 0x00FF00) >>  8;
-      BLE_current_packet[BLE_result_counter+2] = ( result_channel0 & 0xFF0000) >> 16;
-      BLE_current_packet[BLE_result_counter+3] = ( result_channel1 & 0x0000FF)      ;
-      BLE_current_packet[BLE_result_counter+4] = ( result_channel1 & 0x00FF00) >>  8;
-      BLE_current_packet[BLE_result_counter+5] = ( result_channel1 & 0xFF0000) >> 16;
-      BLE_current_packet[BLE_result_counter+6] = (   vdacOUT_value & 0x0000FF)      ;
-      BLE_current_packet[BLE_result_counter+7] = (   vdacOUT_value & 0x00FF00) >>  8;
-      BLE_current_packet[BLE_result_counter+8] = (iadcSAMPLE_count & 0x0000FF)      ;
-      BLE_current_packet[BLE_result_counter+9] = (iadcSAMPLE_count & 0x00FF00) >>  8;
-
-      BLE_result_counter += BLE_DATACHUNKSIZE;
-      if (BLE_result_counter >= BLE_packetSize) {
-          // Packet is complete, enqueue it
-          if (BLE_enqueue_packet(BLE_current_packet, BLE_packetSize)) {
-            // Successfully enqueued, trigger BLE transmission if not already busy
-            if (!BLE_notify_result) {
-              BLE_notify_result = true;
-            }
-          }
-          // Reset counter for next packet regardless of enqueue success
-          BLE_result_counter = 0;
-      }
-
-      // Check if we need to stop measurement after completing the current pulse
-      if (measurement_stop_requested && (samples_in_current_pulse >= iadcSAMPLESperPULSE)) {
-        // All samples for the current pulse have been collected, safe to signal completion
-        measurement_complete = true;
-        measurement_stop_requested = false;
-        samples_in_current_pulse = 0;
-      }
+      iadc_sample_tag_t tag = { vdacOUT_value, iadcSAMPLE_count, vdacOUT_count, electrode_active, gain_active, (uint8_t)waveform_live.cycle, waveform_live.phase };
+      iadcHandleSample(result_channel0, result_channel1, &tag);
     // } else {
     //   // Safety check: if stop was requested but we're not getting samples normally,
     //   // stop anyway to prevent hanging (should not normally happen)
@@ -656,6 +2584,158 @@ void IADC_IRQHandler(void)
 }
 
 
+/**************************************************************************//**
+ * @brief
+ *    Unpack the scans of one LDMA ping-pong half and hand them to iadcHandleSample().
+ *    Each scan is IADC_LDMA_WORDS_PER_SCAN FIFO words; the scan table ID sits in
+ *    bits 31:24 of each word (showId) and the 20-bit result in bits 19:0.
+ *****************************************************************************/
+static void iadcLdmaProcessScans(const uint32_t *words, uint32_t scan_count, uint8_t first_tag)
+{
+  for (uint32_t scan = 0; scan < scan_count; scan++) {
+    uint32_t result_channel0 = 0;
+    uint32_t result_channel1 = 0;
+
+    for (uint32_t i = 0; i < IADC_LDMA_WORDS_PER_SCAN; i++) {
+      uint32_t word = words[scan * IADC_LDMA_WORDS_PER_SCAN + i];
+      if ((word >> 24) == 0) {
+        result_channel0 = word & 0xFFFFF; // 20 bits
+      } else if ((word >> 24) == 1) {
+        result_channel1 = word & 0xFFFFF; // 20 bits
+      }
+    }
+
+    iadc_sample_tag_t *tag = &iadc_ldma_tags[(first_tag + scan) % (2 * IADC_LDMA_SCANS_PER_HALF)];
+    iadcHandleSample(result_channel0, result_channel1, tag);
+  }
+}
+
+// Start the LDMA ping-pong transfer from the IADC scan FIFO (call with the FIFO drained)
+void iadcLdmaStart(void)
+{
+  LDMA_TransferCfg_t transferCfg = LDMA_TRANSFER_CFG_PERIPHERAL(ldmaPeripheralSignal_IADC0_IADC_SCAN);
+
+  // Two descriptors linked to each other: half 0 -> half 1 -> half 0 ...
+  iadc_ldma_descriptors[0] = (LDMA_Descriptor_t) LDMA_DESCRIPTOR_LINKREL_P2M_WORD(&IADC0->SCANFIFODATA, iadc_ldma_buffer[0], IADC_LDMA_WORDS_PER_HALF,  1);
+  iadc_ldma_descriptors[1] = (LDMA_Descriptor_t) LDMA_DESCRIPTOR_LINKREL_P2M_WORD(&IADC0->SCANFIFODATA, iadc_ldma_buffer[1], IADC_LDMA_WORDS_PER_HALF, -1);
+  for (int i = 0; i < 2; i++) {
+    iadc_ldma_descriptors[i].xfer.blockSize = ldmaCtrlBlockSizeUnit2; // One full scan per IADC request (DVL = 2)
+    iadc_ldma_descriptors[i].xfer.doneIfs   = 1;                      // Interrupt once per half
+  }
+
+  iadc_ldma_half = 0;
+  iadc_ldma_tag_index = 0;
+  iadc_ldma_running = true;
+  LDMA_StartTransfer(IADC_LDMA_CHANNEL, &transferCfg, &iadc_ldma_descriptors[0]);
+}
+
+// Stop the LDMA transfer and hand the scans of the partially filled half to the packer
+void iadcLdmaStop(void)
+{
+  if (!iadc_ldma_running) {
+    return;
+  }
+
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
+  LDMA_StopTransfer(IADC_LDMA_CHANNEL);
+  iadc_ldma_running = false;
+
+  uint32_t words_done = IADC_LDMA_WORDS_PER_HALF - LDMA_TransferRemainingCount(IADC_LDMA_CHANNEL);
+  uint8_t  half       = iadc_ldma_half;
+  iadcLdmaProcessScans(iadc_ldma_buffer[half], words_done / IADC_LDMA_WORDS_PER_SCAN,
+                       half * IADC_LDMA_SCANS_PER_HALF);
+  CORE_EXIT_CRITICAL();
+}
+
+void LDMA_IRQHandler(void)
+{
+  uint32_t pending = LDMA_IntGetEnabled();
+
+  if (pending & (1UL << IADC_LDMA_CHANNEL)) {
+    LDMA_IntClear(1UL << IADC_LDMA_CHANNEL);
+
+    uint8_t half = iadc_ldma_half;
+    iadc_ldma_half ^= 1;
+
+    if (measurement_active) {
+      iadcLdmaProcessScans(iadc_ldma_buffer[half], IADC_LDMA_SCANS_PER_HALF,
+                           half * IADC_LDMA_SCANS_PER_HALF);
+    }
+  }
+
+  if (pending & (1UL << VDAC_LDMA_CHANNEL)) {
+    LDMA_IntClear(1UL << VDAC_LDMA_CHANNEL);
+
+    // That half is now in the VDAC FIFO, render the periods that follow the other half into it
+    uint8_t half = vdac_ldma_half;
+    vdac_ldma_half ^= 1;
+
+    if (vdac_playback_active == VDAC_PLAYBACK_LDMA) {
+      waveformFill(&waveform_ahead, vdac_ldma_buffer[half], VDAC_LDMA_WORDS_PER_HALF);
+      vdacRefFill(vdac_ref_ldma_buffer[half], vdac_ldma_buffer[half]);
+    }
+  }
+}
+
+// Prefill the playback ring and let LETIMER0 CH1 clock it into the VDAC (VDAC_PLAYBACK_LDMA only)
+void vdacPlaybackStart(void)
+{
+  if (vdac_playback_active != VDAC_PLAYBACK_LDMA) {
+    return;
+  }
+
+  LDMA_TransferCfg_t transferCfg = LDMA_TRANSFER_CFG_PERIPHERAL(ldmaPeripheralSignal_VDAC0CH0REQ);
+
+  // The first entry is what LETIMER0_IRQHandler would write at the first underflow
+  waveform_ahead = waveform_live;
+  waveformFill(&waveform_ahead, vdac_ldma_buffer[0], VDAC_LDMA_WORDS_PER_HALF);
+  waveformFill(&waveform_ahead, vdac_ldma_buffer[1], VDAC_LDMA_WORDS_PER_HALF);
+  vdacRefFill(vdac_ref_ldma_buffer[0], vdac_ldma_buffer[0]);
+  vdacRefFill(vdac_ref_ldma_buffer[1], vdac_ldma_buffer[1]);
+
+  // Two descriptors linked to each other: half 0 -> half 1 -> half 0 ... (the signal is CH0 in every RUN_MODE)
+  vdac_ldma_descriptors[0] = (LDMA_Descriptor_t) LDMA_DESCRIPTOR_LINKREL_M2P_BYTE(vdac_ldma_buffer[0], &VDAC_SIG_ID->CH0F, VDAC_LDMA_WORDS_PER_HALF,  1);
+  vdac_ldma_descriptors[1] = (LDMA_Descriptor_t) LDMA_DESCRIPTOR_LINKREL_M2P_BYTE(vdac_ldma_buffer[1], &VDAC_SIG_ID->CH0F, VDAC_LDMA_WORDS_PER_HALF, -1);
+  for (int i = 0; i < 2; i++) {
+    vdac_ldma_descriptors[i].xfer.size    = ldmaCtrlSizeWord; // The ring holds one 32-bit CH0F write per entry
+    vdac_ldma_descriptors[i].xfer.doneIfs = 1; // Interrupt once per half
+  }
+
+  vdac_ldma_half = 0;
+  vdacSignalTrigModeSet(vdacTrigModeAsyncPrs);
+
+  // The reference ring follows without interrupts of its own, the signal channel refills both
+  if (vdac_drive == VDAC_DRIVE_BIPOLAR) {
+    LDMA_TransferCfg_t refCfg = LDMA_TRANSFER_CFG_PERIPHERAL(ldmaPeripheralSignal_VDAC1CH0REQ);
+    vdac_ref_ldma_descriptors[0] = (LDMA_Descriptor_t) LDMA_DESCRIPTOR_LINKREL_M2P_BYTE(vdac_ref_ldma_buffer[0], &VDAC_REF_ID->CH0F, VDAC_LDMA_WORDS_PER_HALF,  1);
+    vdac_ref_ldma_descriptors[1] = (LDMA_Descriptor_t) LDMA_DESCRIPTOR_LINKREL_M2P_BYTE(vdac_ref_ldma_buffer[1], &VDAC_REF_ID->CH0F, VDAC_LDMA_WORDS_PER_HALF, -1);
+    for (int i = 0; i < 2; i++) {
+      vdac_ref_ldma_descriptors[i].xfer.size    = ldmaCtrlSizeWord;
+      vdac_ref_ldma_descriptors[i].xfer.doneIfs = 0;
+    }
+    LDMA_StartTransfer(VDAC_REF_LDMA_CHANNEL, &refCfg, &vdac_ref_ldma_descriptors[0]);
+    LDMA_IntDisable(1UL << VDAC_REF_LDMA_CHANNEL); // LDMA_StartTransfer enables it, nothing would clear it
+  }
+  LDMA_StartTransfer(VDAC_LDMA_CHANNEL, &transferCfg, &vdac_ldma_descriptors[0]);
+}
+
+// Stop feeding the VDAC and hand it back to software writes
+void vdacPlaybackStop(void)
+{
+  if (vdac_playback_active != VDAC_PLAYBACK_LDMA) {
+    return;
+  }
+
+  LDMA_StopTransfer(VDAC_LDMA_CHANNEL);
+  if (vdac_drive == VDAC_DRIVE_BIPOLAR) {
+    LDMA_StopTransfer(VDAC_REF_LDMA_CHANNEL);
+  }
+  vdac_playback_active = VDAC_PLAYBACK_CPU;
+  vdacSignalTrigModeSet(vdacTrigModeSw);
+}
+
+
  // MORE LIKE THE ORIGINAL TREVOR VERSION BELOW
 
 // void LETIMER0_IRQHandler(void)
@@ -713,21 +2793,30 @@ void IADC_IRQHandler(void)
 
 // CAMDEN's MODIFIED VERSION BELOW
 
-void LETIMER0_IRQHandler(void)
+// One timebase event: the compare match ahead of the period end starts the scan, the period end
+// (LETIMER0 underflow, TIMER1 overflow) advances the potential program
+static void timebaseEvent(bool compare)
 {
-  uint32_t flags = LETIMER_IntGet(LETIMER0);
-
-  // Check if measurement is active before processing
-  if (!measurement_active) {
-    // Clear interrupt and return without processing
-    LETIMER_IntClear(LETIMER0, flags);
-    return;
-  }
-
-  if (flags & 0x1) {
+  if (compare) {
       iadcSAMPLE_count++;
+      bool in_window = sampleInWindow(iadcSAMPLE_count);
+      if (in_window && iadc_transfer_mode == IADC_TRANSFER_LDMA) {
+        // Remember what this scan belongs to, the LDMA handler tags it once its half is full
+        iadc_ldma_tags[iadc_ldma_tag_index].vdac_value   = vdacOUT_value;
+        iadc_ldma_tags[iadc_ldma_tag_index].sample_count = iadcSAMPLE_count;
+        iadc_ldma_tags[iadc_ldma_tag_index].half_period  = vdacOUT_count;
+        iadc_ldma_tags[iadc_ldma_tag_index].electrode    = electrode_active;
+        iadc_ldma_tags[iadc_ldma_tag_index].gain         = gain_active;
+        iadc_ldma_tags[iadc_ldma_tag_index].cycle        = (uint8_t)waveform_live.cycle;
+        iadc_ldma_tags[iadc_ldma_tag_index].phase        = waveform_live.phase;
+        iadc_ldma_tag_index = (iadc_ldma_tag_index + 1) % (2 * IADC_LDMA_SCANS_PER_HALF);
+      }
       // Trigger an IADC scan conversion (common for all modes)
-      IADC_command(IADC0, iadcCmdStartScan);
+      // With ADC_TRIGGER_PRS the conversion was already started in hardware at the COMP0 match
+      // Slots before the sampling window are not converted at all
+      if (in_window && adc_trigger_source == ADC_TRIGGER_SOFTWARE) {
+        IADC_command(IADC0, iadcCmdStartScan);
+      }
 #if RUN_MODE == 0
       GPIO_PinOutSet(DBG1_OUT_PORT, DBG1_OUT_PIN);
 #endif
@@ -737,112 +2826,121 @@ void LETIMER0_IRQHandler(void)
           GPIO_PinOutSet(DBG2_OUT_PORT, DBG2_OUT_PIN);
 #endif
 
-      if (operating_mode == 0) {
-        if ((iadcSAMPLE_count % iadcSAMPLESperPULSE) == 0) {
-          vdacOUT_count++;
-
-          if ( vdacOUT_count & 0x1) {
-            vdacOUT_value = vdacOUT_offset - vdacOUT_pulse;
-            VDAC_ChannelOutputSet(VDAC_SIG_ID, VDAC_SIG_CH, vdacOUT_value);
-          } else {
-            vdacOUT_offset += vdacOUT_step;
-            if (((vdacOUT_step > 0) && (vdacOUT_offset <= vdacOUT_stop)) ||
-                ((vdacOUT_step < 0) && (vdacOUT_offset >= vdacOUT_stop)) ||
-                (vdacOUT_step == 0) ) {
-              vdacOUT_value = vdacOUT_offset + vdacOUT_pulse;
-              VDAC_ChannelOutputSet(VDAC_SIG_ID, VDAC_SIG_CH, vdacOUT_value);
-            } else {
-              // Request stop after current pulse completes instead of stopping immediately
-                measurement_stop_requested = true;
-            }
-          }
+      // Advance the potential program to this underflow
+      uint8_t events = waveformTick(&waveform_live);
 
-          // Reset samples counter for new pulse
-          // samples_in_current_pulse = 0;
+      if (events & WAVEFORM_EVENT_BOUNDARY) {
+        bool switched = false;
+        if ((events & WAVEFORM_EVENT_ELECTRODE) && electrode_scan_active) {
+          selectElectrode(electrode_list[waveform_live.electrode_index]);
+          switched = true;
         }
-      } else if (operating_mode == 1) {
-        // Linear Sweep Mode - bidirectional sweep (start->stop->start)
-        int16_t current_step = linear_sweep_step;
-        
-        // Reverse step direction if going backwards
-        if (!linear_sweep_direction_forward) {
-          current_step = -current_step;
+        if (gain_autorange_active && (events & WAVEFORM_EVENT_STEP_START) && applyPendingGain(electrode_active)) {
+          switched = true; // Feedback network needs the same settling as a mux switch
         }
-        
-        // Update voltage by current step
-        vdacOUT_value += current_step;
-        
-        // Check if we've reached an endpoint and need to reverse direction
-        bool endpoint_reached = false;
-        if (linear_sweep_direction_forward) {
-          // Going forward (start -> stop)
-          if ((current_step > 0 && vdacOUT_value >= vdacOUT_stop) ||
-              (current_step < 0 && vdacOUT_value <= vdacOUT_stop)) {
-            vdacOUT_value = vdacOUT_stop;
-            linear_sweep_direction_forward = false; // Start going backwards
-            endpoint_reached = true;
-          }
+        if (events & WAVEFORM_EVENT_NO_SAMPLE) {
+          iadc_half_skip = iadcSAMPLESperPULSE;
         } else {
-          // Going backward (stop -> start)
-          if ((current_step > 0 && vdacOUT_value >= vdacOUT_start) ||
-              (current_step < 0 && vdacOUT_value <= vdacOUT_start)) {
-            vdacOUT_value = vdacOUT_start;
-            // Complete cycle - stop measurement or start new cycle
-            measurement_stop_requested = true;
-            endpoint_reached = true;
-          }
+          iadc_half_skip = switched ? electrode_settle_skip : iadc_window_skip;
         }
-        
-        // Update VDAC output
-        VDAC_ChannelOutputSet(VDAC_SIG_ID, VDAC_SIG_CH, vdacOUT_value);
-      } else if (operating_mode == 2) {
-        // Pulse Mode - fast state machine using pre-calculated timing values
-        pulse_timer_count++;
-        
-        switch (pulse_state) {
-          case 0: // Before pulse phase
-            vdacOUT_value = vdacOUT_start;
-            if (pulse_timer_count >= pulse_before_ticks) {
-              pulse_state = 1; // Move to pulse active phase
-              pulse_timer_count = 0; // Reset timer for next phase
-              // Calculate pulse voltage: start + pulse_height
-              vdacOUT_value = vdacOUT_start + pulse_height;
-            }
-            break;
-            
-          case 1: // Pulse active phase
-            // Voltage is already set to start + pulse_height from previous state
-            if (pulse_timer_count >= pulse_width_ticks) {
-              pulse_state = 2; // Move to after pulse phase
-              pulse_timer_count = 0; // Reset timer for next phase
-              vdacOUT_value = vdacOUT_stop; // Set to stop voltage
-            }
-            break;
-            
-          case 2: // After pulse phase
-            vdacOUT_value = vdacOUT_stop;
-            if (pulse_timer_count >= pulse_after_ticks) {
-              pulse_state = 3; // Mark as complete
-              measurement_stop_requested = true;
-            }
-            break;
-            
-          case 3: // Complete - measurement should stop
-          default:
-            measurement_stop_requested = true;
-            break;
+        vdacSignalConnect((events & WAVEFORM_EVENT_OPEN_CIRCUIT) == 0);
+      }
+      // A new top only applies from the next period end, so it is set for the period after the coming one
+      if (chrono_active) {
+        chrono_index = (waveform_live.ticks_left == 0) ? 0 : chrono_index + 1;
+        timebaseNextPeriodSet(chronoPeriodTicks(chrono_index));
+      }
+      if (eis_active && waveform_live.ticks_left == 0 && eis_point + 1 < eis_frequency_count) {
+        eis_point++;
+        timebaseNextPeriodSet(eis_point_ticks[eis_point]);
+      }
+      if (events & WAVEFORM_EVENT_FINISHED) {
+        if (iadc_half_skip >= iadcSAMPLESperPULSE) {
+          // A program that ends unsampled has no scan left to wait for
+          measurement_complete = true;
+        } else {
+          // Request stop after current pulse completes instead of stopping immediately
+          measurement_stop_requested = true;
+        }
+      }
+
+      vdacOUT_count = waveform_live.half_period;
+      if (waveform_live.value != vdacOUT_value) {
+        vdacOUT_value = waveform_live.value;
+        // With LDMA playback the same value was already converted on the LETIMER0 CH1 edge
+        if (vdac_playback_active == VDAC_PLAYBACK_CPU) {
+          vdacOutputSet(vdacOUT_value);
+        }
+      }
+
+      // A PRS trigger cannot be skipped per edge, so arm the scan queue only across the window
+      if (adc_trigger_source == ADC_TRIGGER_PRS) {
+        bool arm = sampleInWindow(iadcSAMPLE_count + 1);
+        if (arm != iadc_prs_armed) {
+          IADC_command(IADC0, arm ? iadcCmdStartScan : iadcCmdStopScan);
+          iadc_prs_armed = arm;
         }
-        
-        // Update VDAC output
-        VDAC_ChannelOutputSet(VDAC_SIG_ID, VDAC_SIG_CH, vdacOUT_value);
       }
   }
 
 #if RUN_MODE == 0
           GPIO_PinOutClear(DBG2_OUT_PORT, DBG2_OUT_PIN);
 #endif
-  // Clear LETIMER interrupt flags
+}
+
+void LETIMER0_IRQHandler(void)
+{
+  uint32_t flags = LETIMER_IntGet(LETIMER0) & (LETIMER_IF_UF | LETIMER_IF_COMP0);
+  uint32_t count = LETIMER_CounterGet(LETIMER0);
+
+  // Clear only the events handled below, one that fires while they run enters again
   LETIMER_IntClear(LETIMER0, flags);
+
+  // Check if measurement is active before processing
+  if (!measurement_active || timebase_active != TIMEBASE_LETIMER) {
+    return;
+  }
+
+  // A lead close to the period, or a late entry behind the BLE stack, can leave both pending. The
+  // counter counts down from the top, so a counter already at or below COMP0 means the underflow came
+  // first and this period's compare followed; otherwise the compare belongs to the period that ended.
+  bool underflow_first = (flags & LETIMER_IF_UF) && (flags & LETIMER_IF_COMP0)
+                         && count <= LETIMER_CompareGet(LETIMER0, 0);
+  if (underflow_first) {
+    timebaseEvent(false);
+  }
+  if (flags & LETIMER_IF_COMP0) {
+    timebaseEvent(true);
+  }
+  if ((flags & LETIMER_IF_UF) && !underflow_first) {
+    timebaseEvent(false);
+  }
+}
+
+void TIMER1_IRQHandler(void)
+{
+  uint32_t flags = TIMER_IntGet(TIMEBASE_HF_TIMER);
+  uint32_t count = TIMER_CounterGet(TIMEBASE_HF_TIMER);
+  TIMER_IntClear(TIMEBASE_HF_TIMER, flags);
+
+  if (!measurement_active || timebase_active != TIMEBASE_HFTIMER) {
+    return;
+  }
+
+  // Short periods, a long lead or a late entry can leave both pending. The counter counts up and the
+  // compare of the new period is loaded at the overflow, so a counter already at or past it means the
+  // period ended before this compare matched; otherwise the compare belongs to the period that ended.
+  bool overflow_first = (flags & TIMER_IF_OF) && (flags & TIMER_IF_CC0)
+                        && count >= TIMER_CaptureGet(TIMEBASE_HF_TIMER, 0);
+  if (overflow_first) {
+    timebaseEvent(false);
+  }
+  if (flags & TIMER_IF_CC0) {
+    timebaseEvent(true);
+  }
+  if ((flags & TIMER_IF_OF) && !overflow_first) {
+    timebaseEvent(false);
+  }
 }
 
 
@@ -854,9 +2952,9 @@ void initVdac(void)
 {
   // Use default settings
   VDAC_Init_TypeDef        initSig        = VDAC_INIT_DEFAULT;
-//  VDAC_Init_TypeDef        initRef        = VDAC_INIT_DEFAULT;
+  VDAC_Init_TypeDef        initRef        = VDAC_INIT_DEFAULT;
   VDAC_InitChannel_TypeDef initChannelSig = VDAC_INITCHANNEL_DEFAULT;
-//  VDAC_InitChannel_TypeDef initChannelRef = VDAC_INITCHANNEL_DEFAULT;
+  VDAC_InitChannel_TypeDef initChannelRef = VDAC_INITCHANNEL_DEFAULT;
 
   // The EM01GRPACLK is chosen as VDAC clock source since the VDAC will be
   // operating in EM1
@@ -864,11 +2962,11 @@ void initVdac(void)
   // If the VDAC is to be operated in EM2 or EM3, VDACn_CLK must be configured to use either HFRCOEM23, EM23GRPACLK or FSRCO instead of the EM01GRPACLK clock.
   // HFRCOEM23 is generally recommended for EM2/EM3 operation
   CMU_ClockSelectSet(cmuClock_VDAC0, cmuSelect_EM01GRPACLK);
-//  CMU_ClockSelectSet(cmuClock_VDAC1, cmuSelect_EM01GRPACLK);
+  CMU_ClockSelectSet(cmuClock_VDAC1, cmuSelect_EM01GRPACLK);
 
   // Enable the VDAC clocks
   CMU_ClockEnable(cmuClock_VDAC0, true);
-//  CMU_ClockEnable(cmuClock_VDAC1, true);
+  CMU_ClockEnable(cmuClock_VDAC1, true);
   //CMU_ClockEnable(cmuClock_PRS, true);
   /*
     * Note: For EFR32xG21 radio devices, library function calls to
@@ -885,10 +2983,10 @@ void initVdac(void)
   initSig.biasKeepWarm = true; // Set to true if iADC is sharing an internal reference voltage. Costs ~4 uA
   initSig.diff         = false;
 
-//  initRef.prescaler    = VDAC_PrescaleCalc(VDAC_REF_ID, (uint32_t) 1000000);
-//  initRef.reference    = VDAC_REF_SELECT;
-//  initRef.biasKeepWarm = true; // Set to true if iADC is sharing an internal reference voltage. Costs ~4 uA
-//  initRef.diff         = false;
+  initRef.prescaler    = VDAC_PrescaleCalc(VDAC_REF_ID, (uint32_t) 1000000);
+  initRef.reference    = VDAC_REF_SELECT;
+  initRef.biasKeepWarm = true; // Set to true if iADC is sharing an internal reference voltage. Costs ~4 uA
+  initRef.diff         = false;
 
   // Since the minimum load requirement for high capacitance mode is 25 nF, turn
   // this mode off
@@ -902,6 +3000,7 @@ void initVdac(void)
   initChannelSig.trigMode = vdacTrigModeSw;
   // initChannel.trigMode = vdacTrigModeAsyncPrs; // Therefore triggered by prsConsumerVDAC0_ASYNCTRIGCH0 in LETIMER
   // vdacTrigModeSyncPrs, vdacTrigModeAsyncPrs
+  // VDAC_PLAYBACK_LDMA switches to vdacTrigModeAsyncPrs for the length of a measurement
 
   initChannelSig.enable        = true;
   initChannelSig.mainOutEnable = false;
@@ -909,23 +3008,22 @@ void initVdac(void)
   initChannelSig.shortOutput   = false;
 
 
-//  // Since the minimum load requirement for high capacitance mode is 25 nF, turn
-//  // this mode off
-//  initChannelRef.highCapLoadEnable = false;
-//  initChannelRef.powerMode = vdacPowerModeHighPower;
-//
-//  initChannelRef.sampleOffMode = false; // false indicates continuous conversion mode
-//  initChannelRef.holdOutTime   = 0;     // Set to zero in continuous mode
-//  initChannelRef.warmupKeepOn  = true;  // Set to true if both channels used to reduce kickback
-//
-//  initChannelRef.trigMode = vdacTrigModeSw;
-//  // initChannel.trigMode = vdacTrigModeAsyncPrs; // Therefore triggered by prsConsumerVDAC0_ASYNCTRIGCH0 in LETIMER
-//  // vdacTrigModeSyncPrs, vdacTrigModeAsyncPrs
-//
-//  initChannelRef.enable        = true;
-//  initChannelRef.mainOutEnable = false;
-//  initChannelRef.auxOutEnable  = true;
-//  initChannelRef.shortOutput   = false;
+  // Since the minimum load requirement for high capacitance mode is 25 nF, turn
+  // this mode off
+  initChannelRef.highCapLoadEnable = false;
+  initChannelRef.powerMode = vdacPowerModeHighPower;
+
+  initChannelRef.sampleOffMode = false; // false indicates continuous conversion mode
+  initChannelRef.holdOutTime   = 0;     // Set to zero in continuous mode
+  initChannelRef.warmupKeepOn  = true;  // Set to true if both channels used to reduce kickback
+
+  initChannelRef.trigMode = vdacTrigModeSw;
+  // VDAC_PLAYBACK_LDMA switches to vdacTrigModeAsyncPrs together with the signal channel (bipolar only)
+
+  initChannelRef.enable        = false; // Enabled by startNewMeasurement() for VDAC_DRIVE_BIPOLAR
+  initChannelRef.mainOutEnable = false;
+  initChannelRef.auxOutEnable  = true;
+  initChannelRef.shortOutput   = false;
 
 
   // Enable the VDAC SIGNAL
@@ -939,29 +3037,59 @@ void initVdac(void)
   VDAC_Init(        VDAC_SIG_ID, &initSig);
   VDAC_InitChannel( VDAC_SIG_ID, &initChannelSig, VDAC_SIG_CH);
   VDAC_Enable(      VDAC_SIG_ID, VDAC_SIG_CH, true);
+  vdac_sig_channel_config = initChannelSig; // Kept for vdacSignalTrigModeSet()
 
-  // Enable the VDAC REFERENCE
+  // Set up the VDAC REFERENCE, left disabled until a bipolar measurement
+
+  initChannelRef.port = VDAC_REF_PORT;
+  initChannelRef.pin  = VDAC_REF_PIN;
+//  GPIO->ABUSALLOC     = VDAC_REF_BUS;
+  GPIO->CDBUSALLOC    = VDAC_REF_BUS;
+//  GPIO->BBUSALLOC     = VDAC_REF_BUS;
+
+  VDAC_Init(        VDAC_REF_ID, &initRef);
+  VDAC_InitChannel( VDAC_REF_ID, &initChannelRef, VDAC_REF_CH);
+  vdac_ref_channel_config = initChannelRef; // Kept for vdacSignalTrigModeSet()
+
+}
 
-//  initChannelRef.port = VDAC_REF_PORT;
-//  initChannelRef.pin  = VDAC_REF_PIN;
-////  GPIO->ABUSALLOC     = VDAC_REF_BUS;
-//  GPIO->CDBUSALLOC    = VDAC_REF_BUS;
-////  GPIO->BBUSALLOC     = VDAC_REF_BUS;
-//
-//  VDAC_Init(        VDAC_REF_ID, &initRef);
-//  VDAC_InitChannel( VDAC_REF_ID, &initChannelRef, VDAC_REF_CH);
-//  VDAC_Enable(      VDAC_REF_ID, VDAC_REF_CH, true);
 
+// Re-initialize the signal channel with another trigger mode (both VDAC0 channels must be disabled for this)
+void vdacSignalTrigModeSet(VDAC_TrigMode_TypeDef trigMode)
+{
+  VDAC_Enable(VDAC_SIG_ID, VDAC_SIG_CH, false);
+  VDAC_SIG_ID->CMD = VDAC_CMD_CH0FIFOFLUSH; // Drop playback values that were never converted
+
+  vdac_sig_channel_config.trigMode = trigMode;
+  VDAC_InitChannel(VDAC_SIG_ID, &vdac_sig_channel_config, VDAC_SIG_CH);
+  VDAC_Enable(     VDAC_SIG_ID, VDAC_SIG_CH, true);
+  vdac_sig_connected = true;
+
+  // The reference channel listens to the same PRS edge, so both outputs step together
+  if (vdac_drive == VDAC_DRIVE_BIPOLAR) {
+    VDAC_Enable(VDAC_REF_ID, VDAC_REF_CH, false);
+    VDAC_REF_ID->CMD = VDAC_CMD_CH0FIFOFLUSH;
+
+    vdac_ref_channel_config.trigMode = trigMode;
+    VDAC_InitChannel(VDAC_REF_ID, &vdac_ref_channel_config, VDAC_REF_CH);
+    VDAC_Enable(     VDAC_REF_ID, VDAC_REF_CH, true);
+  }
 }
 
+// Disable the signal channel for an open circuit; it drives the last written value again once enabled
+void vdacSignalConnect(bool connect)
+{
+  if (connect != vdac_sig_connected) {
+    VDAC_Enable(VDAC_SIG_ID, VDAC_SIG_CH, connect);
+    vdac_sig_connected = connect;
+  }
+}
 
 
 void initIADC(void)
 {
   IADC_Init_t       IADCconfig_init           = IADC_INIT_DEFAULT;
   IADC_AllConfigs_t IADCconfig_initAllConfigs = IADC_ALLCONFIGS_DEFAULT;
-  IADC_InitScan_t   IADCconfig_initScan       = IADC_INITSCAN_DEFAULT;
-  IADC_ScanTable_t  IADCconfig_scanTable      = IADC_SCANTABLE_DEFAULT;
 
   CMU_ClockEnable(cmuClock_IADC0, true);
 
@@ -980,24 +3108,60 @@ void initIADC(void)
   IADCconfig_initAllConfigs.configs[0].vRef       = 1210;
   IADCconfig_initAllConfigs.configs[0].analogGain = iadcCfgAnalogGain0P5x; // 1.21 V / 0.5 multiplier = 2.42 V reference
 
-  // Set the accuracy mode via over-sampling ratio.
-  // Sample rate must be slow enough to support your selection here.
-  // Note ADC_CLK is probably 5 MHz (max in high-accuracy mode)
+  // Set the accuracy mode via over-sampling ratio from the active profile (see iadc_profiles).
+  // planAcquisition() guarantees the sample period is long enough for the selection here.
   // Conversion time = (5us warm-up) + numScanCannels * ((5*OSR + 7) / freq_ADC_CLK)  - for HighAccuracy Mode
-  IADCconfig_initAllConfigs.configs[0].adcMode         = iadcCfgModeHighAccuracy;    // iadcCfgModeNormal ; iadcCfgModeHighAccuracy ; iadcCfgModeHighSpeed
-  IADCconfig_initAllConfigs.configs[0].osrHighAccuracy = iadcCfgOsrHighAccuracy64x; // 5 MHz CLK_ADC --> 0.258 ms per Sample, total = 5 us + 2ch * 258us =  0.521 ms
+  const iadc_profile_t *profile = &iadc_profiles[iadc_active_profile];
+  IADCconfig_initAllConfigs.configs[0].adcMode         = profile->adcMode;
+  IADCconfig_initAllConfigs.configs[0].osrHighSpeed    = profile->osrHighSpeed;
+  IADCconfig_initAllConfigs.configs[0].osrHighAccuracy = profile->osrHighAccuracy;
   // Additional Digital Averaging, only use this if you have already max out over-sampling ratio
-  IADCconfig_initAllConfigs.configs[0].digAvg = iadcDigitalAverage1; // iadcDigitalAverage1 = no averaging
+  IADCconfig_initAllConfigs.configs[0].digAvg = profile->digAvg;
 
   // CLK_SRC_ADC must be prescaled by some value greater than 1 to derive the intended CLK_ADC frequency.
-  IADCconfig_initAllConfigs.configs[0].adcClkPrescale = IADC_calcAdcClkPrescale(IADC0, CLK_ADC_FREQ, 0, // IADC Instance, ADC Clk Frea, CMU Clk Freq (copied from IADC_calcSrcClkPrescale() above)
-                                                                     iadcCfgModeHighAccuracy, // ADC Mode
+  IADCconfig_initAllConfigs.configs[0].adcClkPrescale = IADC_calcAdcClkPrescale(IADC0, profile->clkAdcFreq, 0, // IADC Instance, ADC Clk Frea, CMU Clk Freq (copied from IADC_calcSrcClkPrescale() above)
+                                                                     profile->adcMode, // ADC Mode
                                                                      IADCconfig_init.srcClkPrescale);    // srcClkPrescaler
 
-  // The IADC local timer triggers conversions (scan of multiple channels).
+  // Initialize IADC
+  IADC_init(IADC0, &IADCconfig_init, &IADCconfig_initAllConfigs);
+
+  // Initialize scan
+  initIADCScan();
+
+  // Enable the IADC timer (must be after the IADC is initialized)
+  IADC_command(IADC0, iadcCmdEnableTimer);
+
+  // Allocate the analog bus for ADC0 inputs
+  // Not necessary if using dedicated ADC pins
+  //GPIO->IADC_INPUT_0_BUS |= IADC_INPUT_0_BUSALLOC;
+  //GPIO->IADC_INPUT_1_BUS |= IADC_INPUT_1_BUSALLOC;
+
+  // Enable scan interrupts
+  IADC_enableInt(IADC0, IADC_IEN_SCANTABLEDONE);
+  
+  // Set IADC interrupt priority (lower number = higher priority)
+  // IADC should have lower priority than LETIMER to avoid conflicts
+  NVIC_SetPriority(IADC_IRQn, 1);
+
+  // Enable ADC interrupts
+  NVIC_ClearPendingIRQ(IADC_IRQn);
+  NVIC_EnableIRQ(IADC_IRQn);
+}
+
+// Configure the scan table and trigger; called again at measurement start to apply adc_trigger_source
+void initIADCScan(void)
+{
+  IADC_InitScan_t   IADCconfig_initScan       = IADC_INITSCAN_DEFAULT;
+  IADC_ScanTable_t  IADCconfig_scanTable      = IADC_SCANTABLE_DEFAULT;
+
+  // Software start from the LETIMER ISR, or the LETIMER0 CH0 rising edge over PRS.
 //  IADCconfig_initScan.triggerSelect = iadcTriggerSelTimer;
-//  IADCconfig_initScan.triggerSelect = iadcTriggerSelPrs0PosEdge;
-  IADCconfig_initScan.triggerSelect = iadcTriggerSelImmediate;
+  if (adc_trigger_source == ADC_TRIGGER_PRS) {
+    IADCconfig_initScan.triggerSelect = iadcTriggerSelPrs0PosEdge;
+  } else {
+    IADCconfig_initScan.triggerSelect = iadcTriggerSelImmediate;
+  }
   IADCconfig_initScan.triggerAction = iadcTriggerActionOnce; // or continuous
   IADCconfig_initScan.showId        = true;
   IADCconfig_initScan.start         = false;
@@ -1005,9 +3169,10 @@ void initIADC(void)
   // Make sure to get all of the ADC resolution
   IADCconfig_initScan.alignment = iadcAlignRight20; // Right12 is default
 
-  // Not Used until DMA activated
+  // One DMA request per complete scan (2 entries), used when iadc_transfer_mode == IADC_TRANSFER_LDMA.
+  // Only the LDMA drain needs the FIFO to wake the DMA in EM2, the interrupt path reads it from the ISR.
   IADCconfig_initScan.dataValidLevel = iadcFifoCfgDvl2;
-  IADCconfig_initScan.fifoDmaWakeup  = false;
+  IADCconfig_initScan.fifoDmaWakeup  = (iadc_transfer_mode == IADC_TRANSFER_LDMA);
 
   /*
    * Configure entries in the scan table.  CH0 is single-ended from
@@ -1017,34 +3182,20 @@ void initIADC(void)
   IADCconfig_scanTable.entries[0].negInput      = iadcNegInputGnd;
   IADCconfig_scanTable.entries[0].includeInScan = true;
 
-  IADCconfig_scanTable.entries[1].posInput      = IADC_INPUT_1_POS_PORT_PIN;
-  IADCconfig_scanTable.entries[1].negInput      = iadcNegInputGnd;
-  IADCconfig_scanTable.entries[1].includeInScan = true;
-
-  // Initialize IADC
-  IADC_init(IADC0, &IADCconfig_init, &IADCconfig_initAllConfigs);
-
-  // Initialize scan
-  IADC_initScan(IADC0, &IADCconfig_initScan, &IADCconfig_scanTable);
-
-  // Enable the IADC timer (must be after the IADC is initialized)
-  IADC_command(IADC0, iadcCmdEnableTimer);
+  IADCconfig_scanTable.entries[1].posInput      = IADC_INPUT_1_POS_PORT_PIN;
+  IADCconfig_scanTable.entries[1].negInput      = iadcNegInputGnd;
+  IADCconfig_scanTable.entries[1].includeInScan = true;
 
-  // Allocate the analog bus for ADC0 inputs
-  // Not necessary if using dedicated ADC pins
-  //GPIO->IADC_INPUT_0_BUS |= IADC_INPUT_0_BUSALLOC;
-  //GPIO->IADC_INPUT_1_BUS |= IADC_INPUT_1_BUSALLOC;
+  IADC_initScan(IADC0, &IADCconfig_initScan, &IADCconfig_scanTable);
+}
 
-  // Enable scan interrupts
-  IADC_enableInt(IADC0, IADC_IEN_SCANTABLEDONE);
-  
-  // Set IADC interrupt priority (lower number = higher priority)
-  // IADC should have lower priority than LETIMER to avoid conflicts
-  NVIC_SetPriority(IADC_IRQn, 1);
+void initLdma(void)
+{
+  LDMA_Init_t ldmaInit = LDMA_INIT_DEFAULT;
 
-  // Enable ADC interrupts
-  NVIC_ClearPendingIRQ(IADC_IRQn);
-  NVIC_EnableIRQ(IADC_IRQn);
+  // Same priority as the IADC and LETIMER handlers, they share the BLE packet buffer
+  ldmaInit.ldmaInitIrqPriority = 1;
+  LDMA_Init(&ldmaInit);
 }
 
 void initTimer(void) {
@@ -1057,6 +3208,11 @@ void initTimer(void) {
 
   init.enable  = false;   // Don't start once finished
   init.repMode = letimerRepeatFree;
+  // CH0 goes idle on underflow and active on the COMP0 match, so its rising edge on PRS
+  // lands exactly where LETIMER0_IRQHandler would otherwise start the scan in software
+  init.ufoa0   = letimerUFOAPwm;
+  // CH1 pulses at every underflow, which is where VDAC_PLAYBACK_LDMA converts the next value
+  init.ufoa1   = letimerUFOAPulse;
 
  /*
   // Enable LETIMER0 output0
@@ -1068,10 +3224,14 @@ void initTimer(void) {
 
   LETIMER_Init(LETIMER0, &init); // Write to CTRL register
 
+  // Output actions only happen while REPn is non-zero; the free running mode never counts them down
+  LETIMER_RepeatSet(LETIMER0, 0, 1);
+  LETIMER_RepeatSet(LETIMER0, 1, 1);
+
   uint32_t topValue = (int) ((double) INITIAL_PULSE_WIDTH * 32.768 / iadcSAMPLESperPULSE);
   LETIMER_TopSet(LETIMER0, topValue);
 
-  LETIMER_CompareSet(LETIMER0, 0, 18); // 18 / 32,768 = 0.549 ms > 0.521 ms ADC Sample
+  LETIMER_CompareSet(LETIMER0, 0, iadc_compare_ticks); // 18 / 32,768 = 0.549 ms > 0.521 ms ADC Sample; replanned with the Sample Lead at every start
 
 
   //PRS_ConnectSignal(   PRS_CHANNEL, prsTypeAsync, prsSignalLETIMER0_CH0);
@@ -1091,14 +3251,172 @@ void initTimer(void) {
 }
 
 
-//void initPRS(void) {
-//  // Use LETIMER0 as async PRS to trigger IADC in EM2
-//  CMU_ClockEnable(cmuClock_PRS, true);
-//
-//  /* Set up PRS LETIMER and IADC as producer and consumer respectively */
-//  PRS_SourceAsyncSignalSet(ADC_TRIG_PRS_CHANNEL, PRS_ASYNC_CH_CTRL_SOURCESEL_LETIMER0, PRS_LETIMER0_CH0);
-//  PRS_ConnectConsumer(     ADC_TRIG_PRS_CHANNEL, prsTypeAsync, prsConsumerIADC0_SCANTRIGGER);
-//}
+// TIMER1 timebase: idle until a measurement selects TIMEBASE_HFTIMER
+void initHFTimer(void) {
+  CMU_ClockEnable(cmuClock_TIMER1, true);
+
+  TIMER_Init_TypeDef   timerInit = TIMER_INIT_DEFAULT;
+  TIMER_InitCC_TypeDef ccInit    = TIMER_INITCC_DEFAULT;
+
+  timerInit.enable = false;     // Runs from timebaseStart() only
+
+  // CC0 goes idle on overflow and active on the compare match, the same edge LETIMER0 CH0 gives PRS
+  ccInit.mode      = timerCCModeCompare;
+  ccInit.cmoa      = timerOutputActionSet;
+  ccInit.cofoa     = timerOutputActionClear;
+  ccInit.prsOutput = timerPrsOutputLevel;
+
+  TIMER_Init(TIMEBASE_HF_TIMER, &timerInit);
+  TIMER_InitCC(TIMEBASE_HF_TIMER, 0, &ccInit);
+
+  TIMER_IntEnable(TIMEBASE_HF_TIMER, TIMER_IEN_OF | TIMER_IEN_CC0);
+
+  // Same priority as LETIMER0, only one of them runs a measurement
+  NVIC_SetPriority(TIMER1_IRQn, 1);
+  NVIC_ClearPendingIRQ(TIMER1_IRQn);
+  NVIC_EnableIRQ(TIMER1_IRQn);
+}
+
+
+void initPRS(void) {
+  // Use LETIMER0 as async PRS to trigger IADC in EM2
+  CMU_ClockEnable(cmuClock_PRS, true);
+
+  /* Set up PRS LETIMER and IADC as producer and consumer respectively */
+  // The IADC only listens to this channel while its scan trigger is iadcTriggerSelPrs0PosEdge
+  PRS_SourceAsyncSignalSet(ADC_TRIG_PRS_CHANNEL, PRS_ASYNC_CH_CTRL_SOURCESEL_LETIMER0, PRS_LETIMER0_CH0);
+  PRS_ConnectConsumer(     ADC_TRIG_PRS_CHANNEL, prsTypeAsync, prsConsumerIADC0_SCANTRIGGER);
+
+  // Jitter probe: trigger edge -> TIMER0 CC0, scan table done -> TIMER0 CC1
+  PRS_ConnectConsumer(     ADC_TRIG_PRS_CHANNEL, prsTypeAsync, prsConsumerTIMER0_CC0);
+  PRS_ConnectSignal(       ADC_DONE_PRS_CHANNEL, prsTypeAsync, prsSignalIADC0_SCANTABLE);
+  PRS_ConnectConsumer(     ADC_DONE_PRS_CHANNEL, prsTypeAsync, prsConsumerTIMER0_CC1);
+
+  // VDAC playback: the VDAC only listens to this channel while its trigger mode is vdacTrigModeAsyncPrs
+  PRS_SourceAsyncSignalSet(VDAC_TRIG_PRS_CHANNEL, PRS_ASYNC_CH_CTRL_SOURCESEL_LETIMER0, PRS_LETIMER0_CH1);
+  PRS_ConnectConsumer(     VDAC_TRIG_PRS_CHANNEL, prsTypeAsync, prsConsumerVDAC0_ASYNCTRIGCH0);
+  PRS_ConnectConsumer(     VDAC_TRIG_PRS_CHANNEL, prsTypeAsync, prsConsumerVDAC1_ASYNCTRIGCH0);
+}
+
+
+void initJitterProbe(void) {
+  CMU_ClockEnable(cmuClock_TIMER0, true);
+
+  TIMER_Init_TypeDef   timerInit = TIMER_INIT_DEFAULT;
+  TIMER_InitCC_TypeDef ccInit    = TIMER_INITCC_DEFAULT;
+
+  timerInit.enable = false;     // Free running from jitterProbeStart() only
+
+  ccInit.mode      = timerCCModeCapture;
+  ccInit.edge      = timerEdgeRising;
+  ccInit.eventCtrl = timerEventEveryEdge;
+  ccInit.prsInput  = true;
+  ccInit.prsInputType = timerPrsInputAsyncLevel;
+
+  TIMER_Init(JITTER_PROBE_TIMER, &timerInit);
+  ccInit.prsSel = ADC_TRIG_PRS_CHANNEL;
+  TIMER_InitCC(JITTER_PROBE_TIMER, 0, &ccInit);
+  ccInit.prsSel = ADC_DONE_PRS_CHANNEL;
+  TIMER_InitCC(JITTER_PROBE_TIMER, 1, &ccInit);
+
+  // Both captures interrupt: LETIMER0 CH0 also edges in slots without a scan, so CC0 is drained every edge
+  NVIC_SetPriority(TIMER0_IRQn, 2);
+  NVIC_ClearPendingIRQ(TIMER0_IRQn);
+  NVIC_EnableIRQ(TIMER0_IRQn);
+}
+
+
+void jitterProbeStart(void) {
+  jitter_probe_count     = 0;
+  jitter_probe_min_ticks = 0xFFFFFFFF;
+  jitter_probe_max_ticks = 0;
+  jitter_probe_sum_ticks = 0;
+
+  if (!(adc_trigger_config & ADC_TRIGGER_JITTER_PROBE)) {
+    jitter_probe_active = false;
+    return;
+  }
+
+  // Drop captures left over from the previous run
+  while (!(JITTER_PROBE_TIMER->STATUS & TIMER_STATUS_ICFEMPTY0)) {
+    (void) TIMER_CaptureGet(JITTER_PROBE_TIMER, 0);
+  }
+  while (!(JITTER_PROBE_TIMER->STATUS & TIMER_STATUS_ICFEMPTY1)) {
+    (void) TIMER_CaptureGet(JITTER_PROBE_TIMER, 1);
+  }
+  jitter_probe_edge_valid = false;
+
+  jitter_probe_active = true;
+  TIMER_CounterSet(JITTER_PROBE_TIMER, 0);
+  TIMER_IntClear(JITTER_PROBE_TIMER, TIMER_IF_CC0 | TIMER_IF_CC1 | TIMER_IF_ICFOF0 | TIMER_IF_ICFOF1);
+  TIMER_IntEnable(JITTER_PROBE_TIMER, TIMER_IEN_CC0 | TIMER_IEN_CC1);
+  TIMER_Enable(JITTER_PROBE_TIMER, true);
+}
+
+
+// Publish count, min, max and mean trigger-to-scan-done latency in ns (4 x uint32, little endian)
+void jitterProbeStop(void) {
+  if (!jitter_probe_active) {
+    return;
+  }
+  jitter_probe_active = false;
+  TIMER_IntDisable(JITTER_PROBE_TIMER, TIMER_IEN_CC0 | TIMER_IEN_CC1);
+  TIMER_Enable(JITTER_PROBE_TIMER, false);
+
+  uint32_t timerFreq = CMU_ClockFreqGet(cmuClock_TIMER0);
+  uint32_t jitter_result[4] = {0};
+  jitter_result[0] = jitter_probe_count;
+  if (jitter_probe_count > 0 && timerFreq > 0) {
+    jitter_result[1] = (uint32_t) ((uint64_t) jitter_probe_min_ticks * 1000000000ULL / timerFreq);
+    jitter_result[2] = (uint32_t) ((uint64_t) jitter_probe_max_ticks * 1000000000ULL / timerFreq);
+    jitter_result[3] = (uint32_t) (jitter_probe_sum_ticks * 1000000000ULL / timerFreq / jitter_probe_count);
+  }
+  sl_bt_gatt_server_write_attribute_value(gattdb_TRIGGER_JITTER, 0, sizeof(jitter_result), (uint8_t *) jitter_result);
+}
+
+
+// Trigger-to-result latency: CC1 (scan done) minus the last CC0 (LETIMER0 CH0 edge) before it.
+// Out-of-window slots edge CC0 without a scan, so both capture FIFOs are drained in time order and
+// a scan completion is only paired with the newest edge that precedes it.
+void TIMER0_IRQHandler(void) {
+  uint32_t flags = TIMER_IntGet(JITTER_PROBE_TIMER);
+  TIMER_IntClear(JITTER_PROBE_TIMER, flags);
+
+  bool     have_edge = false;
+  bool     have_done = false;
+  uint32_t edge = 0;
+  uint32_t done = 0;
+  for (;;) {
+    if (!have_edge && !(JITTER_PROBE_TIMER->STATUS & TIMER_STATUS_ICFEMPTY0)) {
+      edge = TIMER_CaptureGet(JITTER_PROBE_TIMER, 0);
+      have_edge = true;
+    }
+    if (!have_done && !(JITTER_PROBE_TIMER->STATUS & TIMER_STATUS_ICFEMPTY1)) {
+      done = TIMER_CaptureGet(JITTER_PROBE_TIMER, 1);
+      have_done = true;
+    }
+
+    if (have_edge && (!have_done || (int32_t)(edge - done) <= 0)) {
+      // Oldest capture is an edge: it replaces any edge that no scan followed
+      jitter_probe_edge_ticks = edge;
+      jitter_probe_edge_valid = true;
+      have_edge = false;
+    } else if (have_done) {
+      if (jitter_probe_active && jitter_probe_edge_valid) {
+        uint32_t latency = done - jitter_probe_edge_ticks;
+
+        if (latency < jitter_probe_min_ticks) jitter_probe_min_ticks = latency;
+        if (latency > jitter_probe_max_ticks) jitter_probe_max_ticks = latency;
+        jitter_probe_sum_ticks += latency;
+        jitter_probe_count++;
+      }
+      jitter_probe_edge_valid = false;
+      have_done = false;
+    } else {
+      break;
+    }
+  }
+}
 
 
 
@@ -1146,13 +3464,15 @@ void app_init(void)
 
   initVdac();
   initGPIO();
-//  initPRS();
+  initPRS();
   initIADC();
+  initLdma();
   initTimer();
+  initHFTimer();
+  initJitterProbe();
 
   vdacOUT_value = vdacOUT_ref;
-  VDAC_ChannelOutputSet(VDAC_SIG_ID, VDAC_SIG_CH, vdacOUT_value);
-//  VDAC_ChannelOutputSet(VDAC_REF_ID, VDAC_REF_CH, vdacOUT_ref);
+  vdacOutputSet(vdacOUT_value);
 }
 
 // Application Process Action.
@@ -1161,49 +3481,60 @@ void app_process_action(void)
   if (app_is_process_required()) {
   }
 
+  // Impedance records are computed here, out of the acquisition interrupt
+  eisProcessResults();
+
   // Handle measurement completion in main loop context (not interrupt context)
   if (measurement_complete) {
     measurement_complete = false;
-    stopThisMeasurement();
-  }
-
-  if (BLE_notify_runExperiment) {
-    sl_status_t sc = send_runExperiment_notification();
-    if (sc == SL_STATUS_OK) {
-        BLE_notify_runExperiment = false;
+    if (prephase_running) {
+      prephaseFinish();
+    } else {
+      stopThisMeasurement();
     }
-    // If notification fails, keep the flag set to retry
   }
 
-  if (BLE_notify_result && !BLE_transmission_busy) {
-      // Try to dequeue and send a packet
-      uint8_t packet_data[BLE_MAX_PACKET_SIZE];
-      uint8_t packet_size;
-      
-      if (BLE_dequeue_packet(packet_data, &packet_size)) {
-          BLE_transmission_busy = true;
-          sl_status_t sc = sl_bt_gatt_server_notify_all(gattdb_ADC_RESULT, packet_size, packet_data);
-          
+  // If a notification fails, it stays queued and is retried
+  bool states_sent = runStateSendDue();
+
+  // Capture-then-upload holds the packets until the scan has stopped
+  bool send_allowed = (capture_policy != CAPTURE_POLICY_UPLOAD) || (!measurement_active && !prephase_running);
+
+  if (states_sent && send_allowed && !ble_ring_is_empty(&BLE_queue) && !BLE_transmission_busy) {
+      // Keep handing packets to the stack until it runs out of buffers, at most one ring's worth per pass
+      BLE_transmission_busy = true;
+      for (uint32_t sent = 0; sent < BLE_queue.capacity; sent++) {
+          // A state change queued at this packet goes out first
+          if (!runStateSendDue()) {
+              break;
+          }
+          uint32_t tail = BLE_queue.tail;
+          ble_packet_t *packet = ble_ring_peek(&BLE_queue);
+          if (BLE_queue.tail != tail) {
+              BLE_head_attempts = 0; // The packet being retried was overwritten
+          }
+          if (packet == NULL) {
+              break; // No more packets to send
+          }
+
+          sl_status_t sc = sl_bt_gatt_server_notify_all(gattdb_ADC_RESULT, packet->size, packet->data);
           if (sc == SL_STATUS_OK) {
-              BLE_transmission_busy = false; // Clear busy flag after successful transmission
-              
-              // Check if there are more packets to send
-              if (!BLE_queue_is_empty()) {
-                  // Keep BLE_notify_result true to continue processing queue
-              } else {
-                  BLE_notify_result = false; // No more packets to send
-              }
+              BLE_pop_packet();
+              continue;
+          }
+
+          if (sc != SL_STATUS_NO_MORE_RESOURCE && ++BLE_head_attempts >= BLE_SEND_MAX_ATTEMPTS) {
+              // Not backpressure, the link keeps rejecting this packet, so give it up and count it
+              BLE_pop_packet();
+              BLE_dropped_packets++;
           } else {
-              // Transmission failed, put the packet back at the front of the queue
-              // For simplicity, we'll just set busy to false and retry next time
-              BLE_transmission_busy = false;
-              // The packet is already dequeued, so we lost it. 
-              // In a more sophisticated system, we could implement a "front insert" operation
+              // Transmission failed, the packet stays at the head of the queue and is retried next pass
+              ble_ring_release(&BLE_queue);
+              BLE_retried_packets++;
           }
-      } else {
-          // Queue is empty
-          BLE_notify_result = false;
+          break;
       }
+      BLE_transmission_busy = false;
   }
 }
 
@@ -1223,6 +3554,13 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
     // Do not call any stack command before receiving this boot event!
     case sl_bt_evt_system_boot_id:
 
+      // Claim the heap the stack left free for the capture buffer
+      captureBufferInit();
+
+      // Accept the largest ATT_MTU a client asks for
+      uint16_t max_mtu_out;
+      sc = sl_bt_gatt_server_set_max_mtu(BLE_ATT_MTU_MAX, &max_mtu_out);
+
       // Initialize Values
       uint16_t vdac_ref_voltage = VDAC_REF_VOLTAGE * 1000;
       sc = sl_bt_gatt_server_write_attribute_value(gattdb_VDAC_REF_GATT,
@@ -1244,6 +3582,8 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
                                                    0, sizeof(time_before_trial), &time_before_trial);
       sc = sl_bt_gatt_server_write_attribute_value(gattdb_TIME_AFTER_TRIAL,
                                                    0, sizeof(time_after_trial), &time_after_trial);
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_PREPHASE_RATE,
+                                                   0, sizeof(prephase_rate), &prephase_rate);
 
       // Initialize operating mode to default (Square Wave Voltammetry)
       sc = sl_bt_gatt_server_write_attribute_value(gattdb_OPERATING_MODE,
@@ -1253,6 +3593,28 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
       sc = sl_bt_gatt_server_write_attribute_value(gattdb_LINEAR_SWEEP_RATE,
                                                    0, sizeof(linear_sweep_rate), &linear_sweep_rate);
 
+      // Initialize cyclic voltammetry to default (one cycle to vdacOUT_stop)
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_LINEAR_SWEEP_CYCLES,
+                                                   0, sizeof(linear_sweep_cycles), &linear_sweep_cycles);
+
+      // Initialize impedance amplitude and periods to default
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_EIS_AMPLITUDE,
+                                                   0, sizeof(eis_amplitude), &eis_amplitude);
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_EIS_PERIODS,
+                                                   0, sizeof(eis_periods), &eis_periods);
+
+      // Initialize timebase to default
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_TIMEBASE,
+                                                   0, sizeof(timebase_request), &timebase_request);
+
+      // Initialize chronoamperometry fast sample rate to default
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_CHRONO_FAST_RATE,
+                                                   0, sizeof(chrono_fast_rate), &chrono_fast_rate);
+
+      // Initialize pulse period to default
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_PULSE_PERIOD,
+                                                   0, sizeof(pulse_period_ms), &pulse_period_ms);
+
       // Initialize linear sweep sample rate to default
       sc = sl_bt_gatt_server_write_attribute_value(gattdb_LINEAR_SWEEP_SAMPLE_RATE,
                                                    0, sizeof(linear_sweep_sample_rate), &linear_sweep_sample_rate);
@@ -1263,6 +3625,56 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
       sc = sl_bt_gatt_server_write_attribute_value(gattdb_TIME_AFTER_PULSE,
                                                    0, sizeof(time_after_pulse), &time_after_pulse);
 
+      // Initialize IADC transfer mode to default (interrupt per scan)
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_ADC_TRANSFER_MODE,
+                                                   0, sizeof(iadc_transfer_mode), &iadc_transfer_mode);
+
+      // Initialize stream mode to default (raw samples)
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_STREAM_MODE,
+                                                   0, sizeof(stream_mode), &stream_mode);
+
+      // Initialize gain autoranging to default (off, fixed gain_channel)
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_GAIN_AUTORANGE,
+                                                   0, sizeof(gain_autorange), &gain_autorange);
+
+      // Initialize VDAC playback to default (written by LETIMER0_IRQHandler)
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_VDAC_PLAYBACK,
+                                                   0, sizeof(vdac_playback), &vdac_playback);
+
+      // Initialize VDAC drive to default (single VDAC against the fixed reference)
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_VDAC_DRIVE,
+                                                   0, sizeof(vdac_drive), &vdac_drive);
+
+      // Initialize capture policy to default (stream live and buffer)
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_CAPTURE_POLICY,
+                                                   0, sizeof(capture_policy), &capture_policy);
+
+      // Initialize electrode round-robin to default (off, single electrode_channel)
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_ELECTRODE_SCAN_MODE,
+                                                   0, sizeof(electrode_scan_mode), &electrode_scan_mode);
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_ELECTRODE_MASK,
+                                                   0, sizeof(electrode_mask), &electrode_mask);
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_ELECTRODE_SETTLE,
+                                                   0, sizeof(electrode_settle_us), &electrode_settle_us);
+
+      // Initialize sampling window to default (whole pulse)
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_SAMPLE_WINDOW_COUNT,
+                                                   0, sizeof(sample_window_count), &sample_window_count);
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_SAMPLE_WINDOW_DELAY,
+                                                   0, sizeof(sample_window_delay_us), &sample_window_delay_us);
+
+      // Initialize sample lead to default (scan ends right before the next step)
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_SAMPLE_LEAD,
+                                                   0, sizeof(iadc_sample_lead_us), &iadc_sample_lead_us);
+
+      // Initialize IADC profile to default (planner picks the highest OSR that fits)
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_ADC_PROFILE,
+                                                   0, sizeof(iadc_profile_request), &iadc_profile_request);
+
+      // Initialize IADC trigger source to default (software start from LETIMER0 ISR)
+      sc = sl_bt_gatt_server_write_attribute_value(gattdb_ADC_TRIGGER,
+                                                   0, sizeof(adc_trigger_config), &adc_trigger_config);
+
       // Create an advertising set.
       sc = sl_bt_advertiser_create_set(&advertising_set_handle);
 
@@ -1286,6 +3698,30 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
     // -------------------------------
     // This event indicates that a new connection was opened.
     case sl_bt_evt_connection_opened_id:
+      // Start from the defaults until the client negotiates more
+      BLE_att_mtu     = BLE_ATT_MTU_DEFAULT;
+      BLE_ll_data_len = BLE_LL_DATA_LEN_DEFAULT;
+      BLE_linkPayloadUpdate();
+
+      // Ask for the 2M PHY and the longest link-layer PDUs, the outcome arrives as events
+      sc = sl_bt_connection_set_preferred_phy(evt->data.evt_connection_opened.connection,
+                                              sl_bt_gap_phy_2m, sl_bt_gap_phy_any);
+      sc = sl_bt_connection_set_data_length(evt->data.evt_connection_opened.connection,
+                                            SL_BT_CONFIG_CONNECTION_DATA_LENGTH, BLE_LL_TX_TIME_US);
+      break;
+
+    // -------------------------------
+    // This event indicates that the ATT_MTU was exchanged with the client.
+    case sl_bt_evt_gatt_mtu_exchanged_id:
+      BLE_att_mtu = evt->data.evt_gatt_mtu_exchanged.mtu;
+      BLE_linkPayloadUpdate();
+      break;
+
+    // -------------------------------
+    // This event indicates that the link-layer data length changed.
+    case sl_bt_evt_connection_data_length_id:
+      BLE_ll_data_len = evt->data.evt_connection_data_length.tx_data_len;
+      BLE_linkPayloadUpdate();
       break;
 
     // -------------------------------
@@ -1366,8 +3802,12 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
             (void)data_recv_len;
             if (sc != SL_STATUS_OK) { break; }
 
-            iadcSAMPLESperPULSE = data_recv_samplesPerPulse;
-            BLE_packetSize = iadcSAMPLESperPULSE * BLE_DATACHUNKSIZE;
+            // pulseSlotTicks() divides by the sample count
+            if (data_recv_samplesPerPulse > 0) {
+                iadc_samples_per_pulse_request = data_recv_samplesPerPulse;
+                iadcSAMPLESperPULSE = data_recv_samplesPerPulse;
+                BLE_packetSize = BLE_pulsePacketSize();
+            }
         }
 
         if ( gattdb_PULSE_WIDTH == evt->data.evt_gatt_server_attribute_value.attribute) {
@@ -1376,14 +3816,12 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
             (void)data_recv_len;
             if (sc != SL_STATUS_OK) { break; }
 
-            // Store pulse width for pulse mode usage
-            pulse_width_ms = data_recv_pulseWidth;
-            calculatePulseTiming(); // Recalculate pulse timing when pulse width changes
-            
-            // Keep original behavior for square wave mode
-            uint32_t topValue = (int) ((double) data_recv_pulseWidth * 32.768 / iadcSAMPLESperPULSE);
-            LETIMER_TopSet(LETIMER0, topValue);
-            LETIMER_CounterSet(LETIMER0, topValue);
+            // Store pulse width for pulse mode usage, a zero width would divide by zero in pulsePeriodHalves()
+            if (data_recv_pulseWidth > 0) {
+                pulse_width_ms = data_recv_pulseWidth;
+                calculatePulseTiming(); // Recalculate pulse timing when pulse width changes
+                // The timebase period itself is programmed at measurement start
+            }
         }
 
         if ( gattdb_TIME_BEFORE_TRIAL == evt->data.evt_gatt_server_attribute_value.attribute) {
@@ -1428,14 +3866,104 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
             }
         }
 
+        if ( gattdb_GAIN_AUTORANGE == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint8_t data_recv_gainAutorange;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_GAIN_AUTORANGE, 0, sizeof(data_recv_gainAutorange), &data_recv_len, &data_recv_gainAutorange);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            // 0 = fixed gain_channel, 1 = autorange starting from gain_channel
+            if (data_recv_gainAutorange <= 1 && !measurement_active) {
+                gain_autorange = data_recv_gainAutorange;
+            }
+        }
+
+        if ( gattdb_WAVEFORM_PROGRAM == evt->data.evt_gatt_server_attribute_value.attribute) {
+            // Segments for operating_mode 3, compiled by waveformPlan() at the next start
+            if (!measurement_active) {
+                sc = sl_bt_gatt_server_read_attribute_value(gattdb_WAVEFORM_PROGRAM, 0, sizeof(waveform_program), &data_recv_len, waveform_program);
+                if (sc != SL_STATUS_OK) { break; }
+                waveform_program_len = (uint8_t)data_recv_len;
+            }
+        }
+
+        if ( gattdb_VDAC_PLAYBACK == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint8_t data_recv_vdacPlayback;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_VDAC_PLAYBACK, 0, sizeof(data_recv_vdacPlayback), &data_recv_len, &data_recv_vdacPlayback);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            // 0 = VDAC written by LETIMER0_IRQHandler, 1 = LDMA playback triggered by LETIMER0 CH1
+            if (data_recv_vdacPlayback <= VDAC_PLAYBACK_LDMA && !measurement_active) {
+                vdac_playback = data_recv_vdacPlayback;
+            }
+        }
+
+        if ( gattdb_VDAC_DRIVE == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint8_t data_recv_vdacDrive;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_VDAC_DRIVE, 0, sizeof(data_recv_vdacDrive), &data_recv_len, &data_recv_vdacDrive);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            // 0 = VDAC0 against the fixed reference, 1 = VDAC1 drives the reference with the complement
+            if (data_recv_vdacDrive <= VDAC_DRIVE_BIPOLAR && !measurement_active) {
+                vdac_drive = data_recv_vdacDrive;
+                calculateLinearSweepStep(); // Counts per mV halve in bipolar mode
+            }
+        }
+
+        if ( gattdb_CAPTURE_POLICY == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint8_t data_recv_capturePolicy;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_CAPTURE_POLICY, 0, sizeof(data_recv_capturePolicy), &data_recv_len, &data_recv_capturePolicy);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            // 0 = stream and buffer, 1 = capture then upload, 2 = stream and drop oldest; never mid-measurement
+            if (data_recv_capturePolicy <= CAPTURE_POLICY_DROP_OLDEST && !measurement_active && !prephase_running) {
+                capture_policy = data_recv_capturePolicy;
+            }
+        }
+
+        if ( gattdb_ELECTRODE_SCAN_MODE == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint8_t data_recv_electrodeScanMode;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_ELECTRODE_SCAN_MODE, 0, sizeof(data_recv_electrodeScanMode), &data_recv_len, &data_recv_electrodeScanMode);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            // Ensure the scan mode is valid and never change the electrode sequence mid-measurement
+            if (data_recv_electrodeScanMode <= ELECTRODE_SCAN_PER_PULSE && !measurement_active) {
+                electrode_scan_mode = data_recv_electrodeScanMode;
+            }
+        }
+
+        if ( gattdb_ELECTRODE_MASK == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint8_t data_recv_electrodeMask;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_ELECTRODE_MASK, 0, sizeof(data_recv_electrodeMask), &data_recv_len, &data_recv_electrodeMask);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            if (!measurement_active) {
+                electrode_mask = data_recv_electrodeMask; // Bit n = electrode n (0-7)
+            }
+        }
+
+        if ( gattdb_ELECTRODE_SETTLE == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint16_t data_recv_electrodeSettle;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_ELECTRODE_SETTLE, 0, sizeof(data_recv_electrodeSettle), &data_recv_len, &data_recv_electrodeSettle);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            electrode_settle_us = data_recv_electrodeSettle; // Applied by planSampleWindow() at the next start
+        }
+
         if ( gattdb_OPERATING_MODE == evt->data.evt_gatt_server_attribute_value.attribute) {
             uint8_t data_recv_operatingMode;
             sc = sl_bt_gatt_server_read_attribute_value(gattdb_OPERATING_MODE, 0, sizeof(data_recv_operatingMode), &data_recv_len, &data_recv_operatingMode);
             (void)data_recv_len;
             if (sc != SL_STATUS_OK) { break; }
 
-            // Ensure the operating mode value is valid (0, 1, or 2)
-            if (data_recv_operatingMode <= 2) {
+            // Ensure the operating mode value is valid (0 to 8)
+            if (data_recv_operatingMode <= 8) {
                 operating_mode = data_recv_operatingMode;
                 // Recalculate timing when operating mode changes
                 calculateLinearSweepStep();
@@ -1453,12 +3981,153 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
             calculateLinearSweepStep(); // Recalculate step when rate changes
         }
 
+        if ( gattdb_PULSE_PERIOD == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint16_t data_recv_pulsePeriod;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_PULSE_PERIOD, 0, sizeof(data_recv_pulsePeriod), &data_recv_len, &data_recv_pulsePeriod);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            if (data_recv_pulsePeriod > 0 && !measurement_active) {
+                pulse_period_ms = data_recv_pulsePeriod;
+            }
+        }
+
+        if ( gattdb_LINEAR_SWEEP_CYCLES == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint16_t data_recv_linearSweepCycles;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_LINEAR_SWEEP_CYCLES, 0, sizeof(data_recv_linearSweepCycles), &data_recv_len, &data_recv_linearSweepCycles);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            // 0 = cycle until stopped
+            if (!measurement_active) {
+                linear_sweep_cycles = data_recv_linearSweepCycles;
+            }
+        }
+
+        if ( gattdb_LINEAR_SWEEP_VERTICES == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint16_t data_recv_linearSweepVertices[LINEAR_SWEEP_MAX_VERTICES];
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_LINEAR_SWEEP_VERTICES, 0, sizeof(data_recv_linearSweepVertices), &data_recv_len, data_recv_linearSweepVertices);
+            if (sc != SL_STATUS_OK) { break; }
+
+            // Same units as Voltage Stop; an empty list turns at vdacOUT_stop only
+            if (!measurement_active) {
+                linear_sweep_vertex_count = data_recv_len / sizeof(uint16_t);
+                for (uint8_t i = 0; i < linear_sweep_vertex_count; i++) {
+                    linear_sweep_vertices[i] = (uint16_t)((int16_t)data_recv_linearSweepVertices[i] + vdacOUT_offset_volts);
+                }
+            }
+        }
+
+        if ( gattdb_TIMEBASE == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint8_t data_recv_timebase;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_TIMEBASE, 0, sizeof(data_recv_timebase), &data_recv_len, &data_recv_timebase);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            // Latched at the next measurement start
+            if (data_recv_timebase <= TIMEBASE_HFTIMER) {
+                timebase_request = data_recv_timebase;
+            }
+        }
+
+        if ( gattdb_EIS_FREQUENCIES == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint16_t data_recv_eisFrequencies[EIS_MAX_FREQUENCIES];
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_EIS_FREQUENCIES, 0, sizeof(data_recv_eisFrequencies), &data_recv_len, data_recv_eisFrequencies);
+            if (sc != SL_STATUS_OK) { break; }
+
+            // Frequencies in 0.1 Hz, measured in the order given
+            if (!measurement_active) {
+                eis_frequency_count = data_recv_len / sizeof(uint16_t);
+                for (uint8_t i = 0; i < eis_frequency_count; i++) {
+                    eis_frequencies[i] = data_recv_eisFrequencies[i];
+                }
+            }
+        }
+
+        if ( gattdb_EIS_AMPLITUDE == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint16_t data_recv_eisAmplitude;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_EIS_AMPLITUDE, 0, sizeof(data_recv_eisAmplitude), &data_recv_len, &data_recv_eisAmplitude);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            if (data_recv_eisAmplitude <= 2047 && !measurement_active) {
+                eis_amplitude = data_recv_eisAmplitude;
+            }
+        }
+
+        if ( gattdb_EIS_PERIODS == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint8_t data_recv_eisPeriods;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_EIS_PERIODS, 0, sizeof(data_recv_eisPeriods), &data_recv_len, &data_recv_eisPeriods);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            if (data_recv_eisPeriods > 0 && !measurement_active) {
+                eis_periods = data_recv_eisPeriods;
+            }
+        }
+
+        if ( gattdb_PREPHASE_STEPS == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint16_t data_recv_prephaseSteps[2 * PREPHASE_MAX_STEPS];
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_PREPHASE_STEPS, 0, sizeof(data_recv_prephaseSteps), &data_recv_len, data_recv_prephaseSteps);
+            if (sc != SL_STATUS_OK) { break; }
+
+            // Pairs of potential (same units as Voltage Stop, 0xFFFF = open circuit) and duration in 0.1 s
+            if (!measurement_active) {
+                prephase_step_count = data_recv_len / (2 * sizeof(uint16_t));
+                for (uint8_t i = 0; i < prephase_step_count; i++) {
+                    uint16_t potential = data_recv_prephaseSteps[2 * i];
+                    prephase_steps[i].potential   = (potential == PREPHASE_OPEN_CIRCUIT) ? PREPHASE_OPEN_CIRCUIT
+                                                  : (uint16_t)((int16_t)potential + vdacOUT_offset_volts);
+                    prephase_steps[i].duration_ds = data_recv_prephaseSteps[2 * i + 1];
+                }
+            }
+        }
+
+        if ( gattdb_PREPHASE_RATE == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint16_t data_recv_prephaseRate;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_PREPHASE_RATE, 0, sizeof(data_recv_prephaseRate), &data_recv_len, &data_recv_prephaseRate);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            if (data_recv_prephaseRate > 0 && !measurement_active) {
+                prephase_rate = data_recv_prephaseRate;
+            }
+        }
+
+        if ( gattdb_CHRONO_STEPS == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint16_t data_recv_chronoSteps[2 * CHRONO_MAX_STEPS];
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_CHRONO_STEPS, 0, sizeof(data_recv_chronoSteps), &data_recv_len, data_recv_chronoSteps);
+            if (sc != SL_STATUS_OK) { break; }
+
+            // Pairs of potential (same units as Voltage Stop) and duration in ms
+            if (!measurement_active) {
+                chrono_step_count = data_recv_len / (2 * sizeof(uint16_t));
+                for (uint8_t i = 0; i < chrono_step_count; i++) {
+                    chrono_steps[i].potential   = (uint16_t)((int16_t)data_recv_chronoSteps[2 * i] + vdacOUT_offset_volts);
+                    chrono_steps[i].duration_ms = data_recv_chronoSteps[2 * i + 1];
+                }
+            }
+        }
+
+        if ( gattdb_CHRONO_FAST_RATE == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint16_t data_recv_chronoFastRate;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_CHRONO_FAST_RATE, 0, sizeof(data_recv_chronoFastRate), &data_recv_len, &data_recv_chronoFastRate);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            if (data_recv_chronoFastRate > 0 && !measurement_active) {
+                chrono_fast_rate_request = data_recv_chronoFastRate;
+                chrono_fast_rate = data_recv_chronoFastRate;
+            }
+        }
+
         if ( gattdb_LINEAR_SWEEP_SAMPLE_RATE == evt->data.evt_gatt_server_attribute_value.attribute) {
             uint16_t data_recv_linearSweepSampleRate;
             sc = sl_bt_gatt_server_read_attribute_value(gattdb_LINEAR_SWEEP_SAMPLE_RATE, 0, sizeof(data_recv_linearSweepSampleRate), &data_recv_len, &data_recv_linearSweepSampleRate);
             (void)data_recv_len;
             if (sc != SL_STATUS_OK) { break; }
 
+            linear_sweep_sample_rate_request = data_recv_linearSweepSampleRate;
             linear_sweep_sample_rate = data_recv_linearSweepSampleRate;
             calculateLinearSweepStep(); // Recalculate step when sample rate changes
             calculatePulseTiming(); // Recalculate pulse timing when sample rate changes
@@ -1484,6 +4153,81 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
             calculatePulseTiming(); // Recalculate pulse timing when time_after_pulse changes
         }
 
+        if ( gattdb_ADC_TRANSFER_MODE == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint8_t data_recv_adcTransferMode;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_ADC_TRANSFER_MODE, 0, sizeof(data_recv_adcTransferMode), &data_recv_len, &data_recv_adcTransferMode);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            // Ensure the transfer mode is valid and never switch it under a running measurement
+            if (data_recv_adcTransferMode <= IADC_TRANSFER_LDMA && !measurement_active) {
+                iadc_transfer_mode = data_recv_adcTransferMode;
+            }
+        }
+
+        if ( gattdb_SAMPLE_WINDOW_COUNT == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint16_t data_recv_sampleWindowCount;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_SAMPLE_WINDOW_COUNT, 0, sizeof(data_recv_sampleWindowCount), &data_recv_len, &data_recv_sampleWindowCount);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            sample_window_count = data_recv_sampleWindowCount; // Applied by planSampleWindow() at the next start
+        }
+
+        if ( gattdb_SAMPLE_WINDOW_DELAY == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint32_t data_recv_sampleWindowDelay;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_SAMPLE_WINDOW_DELAY, 0, sizeof(data_recv_sampleWindowDelay), &data_recv_len, &data_recv_sampleWindowDelay);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            sample_window_delay_us = data_recv_sampleWindowDelay; // Applied by planSampleWindow() at the next start
+        }
+
+        if ( gattdb_SAMPLE_LEAD == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint32_t data_recv_sampleLead;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_SAMPLE_LEAD, 0, sizeof(data_recv_sampleLead), &data_recv_len, &data_recv_sampleLead);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            iadc_sample_lead_us = data_recv_sampleLead; // Clamped by planAcquisition() at the next start
+        }
+
+        if ( gattdb_STREAM_MODE == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint8_t data_recv_streamMode;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_STREAM_MODE, 0, sizeof(data_recv_streamMode), &data_recv_len, &data_recv_streamMode);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            // Ensure the stream mode is valid and never switch record formats mid-measurement
+            if (data_recv_streamMode <= STREAM_MODE_SWV_DIFF && !measurement_active) {
+                stream_mode = data_recv_streamMode;
+            }
+        }
+
+        if ( gattdb_ADC_PROFILE == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint8_t data_recv_adcProfile;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_ADC_PROFILE, 0, sizeof(data_recv_adcProfile), &data_recv_len, &data_recv_adcProfile);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            // Table index or auto; the IADC is re-initialized by planAcquisition() at the next start
+            if (data_recv_adcProfile < IADC_PROFILE_COUNT || data_recv_adcProfile == IADC_PROFILE_AUTO) {
+                iadc_profile_request = data_recv_adcProfile;
+            }
+        }
+
+        if ( gattdb_ADC_TRIGGER == evt->data.evt_gatt_server_attribute_value.attribute) {
+            uint8_t data_recv_adcTrigger;
+            sc = sl_bt_gatt_server_read_attribute_value(gattdb_ADC_TRIGGER, 0, sizeof(data_recv_adcTrigger), &data_recv_len, &data_recv_adcTrigger);
+            (void)data_recv_len;
+            if (sc != SL_STATUS_OK) { break; }
+
+            // Bit 0 selects software/PRS trigger, bit 7 enables the jitter probe; applied at the next start
+            if ((data_recv_adcTrigger & ~(ADC_TRIGGER_SOURCE_MASK | ADC_TRIGGER_JITTER_PROBE)) == 0) {
+                adc_trigger_config = data_recv_adcTrigger;
+            }
+        }
+
         if (gattdb_RUN_EXPERIMENT == evt->data.evt_gatt_server_attribute_value.attribute) {
             uint8_t data_recv_runExperiment;
             sc = sl_bt_gatt_server_read_attribute_value(gattdb_RUN_EXPERIMENT, 0, sizeof(data_recv_runExperiment), &data_recv_len, &data_recv_runExperiment);
@@ -1493,8 +4237,14 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
             if (data_recv_runExperiment == 0x01) {
               startNewMeasurement();
             } else if (data_recv_runExperiment == 0x0) {
-                // Request stop after current pulse completes instead of stopping immediately
-                measurement_stop_requested = true;
+                if (prephase_running) {
+                    // Nothing of the pre-phase needs finishing, and the scan does not start any more
+                    prephase_running = false;
+                    measurement_complete = true;
+                } else {
+                    // Request stop after current pulse completes instead of stopping immediately
+                    measurement_stop_requested = true;
+                }
             }
         }
 
@@ -1533,12 +4283,12 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
  ******************************************************************************/
 
 
-static sl_status_t send_runExperiment_notification()
+static sl_status_t send_runExperiment_notification(uint8_t value)
 {
   sl_status_t sc;
 
   // Send characteristic notification.
-  sc = sl_bt_gatt_server_notify_all(gattdb_RUN_EXPERIMENT, sizeof(BLE_value_runExperiment), &BLE_value_runExperiment);
+  sc = sl_bt_gatt_server_notify_all(gattdb_RUN_EXPERIMENT, sizeof(value), &value);
   if (sc != SL_STATUS_OK) { return sc; }
 
   return sc;
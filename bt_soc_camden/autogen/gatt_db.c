@@ -48,6 +48,191 @@ GATT_DATA(const uint8_t gattdb_uuidtable_128_map[]) =
   0xfb, 0x33, 0xdd, 0x77, 0xda, 0xe4, 0xab, 0x91, 0x2f, 0x44, 0x21, 0x1d, 0xe1, 0x97, 0x3d, 0xf9, 
   0x2f, 0x8b, 0x03, 0xdb, 0x44, 0x5d, 0x93, 0x87, 0x9f, 0x4e, 0x0b, 0x89, 0xad, 0x9e, 0x99, 0x0a, 
   0xff, 0x01, 0xe4, 0x1c, 0xcc, 0x99, 0x22, 0xb4, 0xe1, 0x44, 0x4d, 0x70, 0xfa, 0x05, 0x3a, 0x84, 
+  0xa2, 0xe9, 0xd9, 0x45, 0xd1, 0x06, 0xfe, 0xaf, 0x08, 0x46, 0xc4, 0x79, 0x97, 0x27, 0x7b, 0xd5, 
+  0x06, 0x52, 0x30, 0x94, 0x91, 0xb3, 0x77, 0x9a, 0x2f, 0x48, 0x22, 0x69, 0x63, 0x8a, 0x6e, 0xe9, 
+  0x6c, 0x54, 0x4c, 0x8a, 0x30, 0xa7, 0x29, 0x98, 0xe4, 0x46, 0x61, 0x5a, 0x21, 0xd0, 0x0d, 0x23, 
+  0x16, 0x88, 0xe4, 0x95, 0xa7, 0x0c, 0x9e, 0xb5, 0x9d, 0x4f, 0xfe, 0x70, 0x18, 0x51, 0x5b, 0xfc, 
+  0x58, 0x3b, 0x3c, 0xd6, 0x36, 0x83, 0x40, 0x80, 0x83, 0x48, 0x05, 0x36, 0xb5, 0xba, 0x62, 0x17, 
+  0x83, 0x1c, 0x35, 0x5b, 0x3b, 0x41, 0x68, 0x9e, 0xed, 0x49, 0xe2, 0x59, 0x12, 0x0f, 0x51, 0x62, 
+  0x5a, 0xd6, 0x89, 0x3b, 0xe5, 0x1f, 0x7f, 0xbe, 0xc6, 0x49, 0xc3, 0xfb, 0x6f, 0x50, 0xc1, 0xea, 
+  0x92, 0xbd, 0xe8, 0x7b, 0x19, 0xb8, 0x60, 0x89, 0x61, 0x49, 0xf2, 0xc9, 0x91, 0x1d, 0x23, 0x72, 
+  0x58, 0xab, 0xbe, 0x08, 0x9c, 0x70, 0x33, 0xad, 0x48, 0x4f, 0xaf, 0xb6, 0x65, 0x33, 0x29, 0x0b, 
+  0x57, 0xb4, 0xe7, 0x7f, 0xa5, 0x71, 0x81, 0x81, 0x21, 0x47, 0x39, 0x39, 0x4f, 0xcf, 0x33, 0x70, 
+  0xe0, 0xda, 0x27, 0xe6, 0x56, 0xad, 0x32, 0xa9, 0x3b, 0x42, 0x15, 0x32, 0x4b, 0x23, 0xc7, 0x06, 
+  0x2c, 0x79, 0x50, 0x9c, 0x24, 0x4f, 0xca, 0x9c, 0xfa, 0x42, 0xcd, 0x71, 0x35, 0xd2, 0x28, 0xa7, 
+  0xf9, 0xf1, 0x55, 0x51, 0x16, 0x01, 0x9d, 0x97, 0x46, 0x4a, 0x2b, 0x4b, 0x55, 0xe4, 0x79, 0x36, 
+  0xf9, 0xf1, 0x1e, 0x2f, 0xf1, 0xa7, 0x0a, 0xb7, 0xa6, 0x48, 0x3b, 0xca, 0xcd, 0xe1, 0x79, 0x2c, 
+  0x15, 0x6f, 0x60, 0x3d, 0x9a, 0xd8, 0xa4, 0x92, 0x2d, 0x49, 0x3b, 0x86, 0x12, 0x4e, 0x77, 0xd5, 
+  0x97, 0xaa, 0x58, 0xed, 0x9e, 0x5e, 0xbf, 0x9e, 0x33, 0x40, 0xe0, 0x94, 0x3e, 0xe1, 0xc9, 0x3b, 
+  0xd9, 0xa3, 0x39, 0x3d, 0xfa, 0xcb, 0x6c, 0xa9, 0x49, 0x48, 0x60, 0x3f, 0xf6, 0xc7, 0xdc, 0xac, 
+  0xe7, 0xed, 0xc4, 0xaa, 0xe8, 0x5d, 0x19, 0xb8, 0x8c, 0x4e, 0xf6, 0xc7, 0xc5, 0x1d, 0x6b, 0x29, 
+  0xd0, 0x0e, 0xf9, 0x59, 0x17, 0x96, 0x68, 0x86, 0xcb, 0x47, 0x9d, 0xb7, 0x3b, 0xd4, 0x01, 0x4f, 
+  0x2a, 0x74, 0xc5, 0xfe, 0xcf, 0x4f, 0x19, 0xa8, 0xcb, 0x4a, 0x8c, 0x30, 0x6c, 0x61, 0x00, 0xa7, 
+  0x97, 0x2e, 0x1f, 0x65, 0xc9, 0x54, 0x46, 0x80, 0x05, 0x42, 0x8a, 0x85, 0xf1, 0x5c, 0xec, 0x9f, 
+  0xfb, 0xb6, 0x0b, 0xc6, 0xb1, 0xc0, 0xa4, 0xbc, 0xbd, 0x48, 0xf0, 0xfd, 0xfd, 0x72, 0xfe, 0xdb, 
+  0x28, 0x70, 0x36, 0xf0, 0x61, 0x9c, 0x09, 0x9f, 0x21, 0x44, 0x81, 0x89, 0x0b, 0x74, 0x75, 0x84, 
+  0x76, 0x9b, 0x2c, 0x0b, 0x50, 0xab, 0xc2, 0xb2, 0x64, 0x4a, 0x62, 0x31, 0x11, 0x34, 0x33, 0xbe, 
+  0x2b, 0x0f, 0x92, 0x29, 0x17, 0x78, 0x3d, 0xbf, 0x15, 0x46, 0x22, 0x3f, 0xb0, 0x18, 0x96, 0x67, 
+  0x1b, 0x29, 0xcb, 0xeb, 0x66, 0x74, 0xe5, 0xbd, 0x83, 0x44, 0x87, 0x08, 0xd7, 0xdf, 0x35, 0x2a, 
+  0xde, 0xd1, 0xc6, 0x3f, 0x80, 0xb7, 0x70, 0xbe, 0xdb, 0x41, 0x92, 0xc6, 0xf6, 0xae, 0x29, 0x94, 
+  0x53, 0x4b, 0xec, 0xa8, 0xc3, 0xd0, 0x6c, 0xac, 0xd2, 0x47, 0x4d, 0x9c, 0x47, 0x06, 0x8a, 0x04, 
+  0xb0, 0x6d, 0xa2, 0xc3, 0x50, 0x28, 0x10, 0xba, 0x6b, 0x48, 0x33, 0x2f, 0x1f, 0x3f, 0xb2, 0x2c, 
+  0x78, 0x99, 0x48, 0xe3, 0xbe, 0x1d, 0xec, 0x95, 0x61, 0x48, 0xb0, 0xcd, 0x0b, 0x03, 0xbe, 0xe2, 
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_128) = {
+  .properties = 0x02,
+  .max_len = 12,
+  .data = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_126) = {
+  .properties = 0x0a,
+  .max_len = 1,
+  .data = { 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_124) = {
+  .properties = 0x0a,
+  .max_len = 1,
+  .data = { 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_122) = {
+  .properties = 0x0a,
+  .max_len = 4,
+  .data = { 0x00, 0x00, 0x00, 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_120) = {
+  .properties = 0x0a,
+  .max_len = 2,
+  .data = { 0x00, 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_118) = {
+  .properties = 0x0a,
+  .max_len = 16,
+  .len = 0,
+  .data = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_116) = {
+  .properties = 0x0a,
+  .max_len = 1,
+  .data = { 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_114) = {
+  .properties = 0x0a,
+  .max_len = 2,
+  .data = { 0x00, 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_112) = {
+  .properties = 0x0a,
+  .max_len = 32,
+  .len = 0,
+  .data = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_110) = {
+  .properties = 0x0a,
+  .max_len = 1,
+  .data = { 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_108) = {
+  .properties = 0x0a,
+  .max_len = 2,
+  .data = { 0x00, 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_106) = {
+  .properties = 0x0a,
+  .max_len = 32,
+  .len = 0,
+  .data = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_104) = {
+  .properties = 0x0a,
+  .max_len = 2,
+  .data = { 0x00, 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_102) = {
+  .properties = 0x0a,
+  .max_len = 8,
+  .len = 0,
+  .data = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_100) = {
+  .properties = 0x0a,
+  .max_len = 2,
+  .data = { 0x00, 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_98) = {
+  .properties = 0x02,
+  .max_len = 2,
+  .data = { 0x00, 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_96) = {
+  .properties = 0x0a,
+  .max_len = 240,
+  .len = 0,
+  .data = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_94) = {
+  .properties = 0x0a,
+  .max_len = 1,
+  .data = { 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_92) = {
+  .properties = 0x0a,
+  .max_len = 1,
+  .data = { 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_90) = {
+  .properties = 0x0a,
+  .max_len = 2,
+  .data = { 0x00, 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_88) = {
+  .properties = 0x0a,
+  .max_len = 1,
+  .data = { 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_86) = {
+  .properties = 0x0a,
+  .max_len = 1,
+  .data = { 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_84) = {
+  .properties = 0x0a,
+  .max_len = 4,
+  .data = { 0x00, 0x00, 0x00, 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_82) = {
+  .properties = 0x0a,
+  .max_len = 2,
+  .data = { 0x00, 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_80) = {
+  .properties = 0x0a,
+  .max_len = 1,
+  .data = { 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_78) = {
+  .properties = 0x02,
+  .max_len = 14,
+  .data = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_76) = {
+  .properties = 0x0a,
+  .max_len = 1,
+  .data = { 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_74) = {
+  .properties = 0x02,
+  .max_len = 16,
+  .data = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_72) = {
+  .properties = 0x0a,
+  .max_len = 1,
+  .data = { 0x00, },
+};
+GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_70) = {
+  .properties = 0x0a,
+  .max_len = 1,
+  .data = { 0x00, },
 };
 GATT_DATA(sli_bt_gattdb_attribute_chrvalue_t gattdb_attribute_field_68) = {
   .properties = 0x0a,
@@ -292,18 +477,78 @@ GATT_DATA(const sli_bt_gattdb_attribute_t gattdb_attributes_map[]) = {
   { .handle = 0x43, .uuid = 0x8013, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_66 },
   { .handle = 0x44, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x8014 } },
   { .handle = 0x45, .uuid = 0x8014, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_68 },
+  { .handle = 0x46, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x8015 } },
+  { .handle = 0x47, .uuid = 0x8015, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_70 },
+  { .handle = 0x48, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x8016 } },
+  { .handle = 0x49, .uuid = 0x8016, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_72 },
+  { .handle = 0x4a, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x02, .char_uuid = 0x8017 } },
+  { .handle = 0x4b, .uuid = 0x8017, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_74 },
+  { .handle = 0x4c, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x8018 } },
+  { .handle = 0x4d, .uuid = 0x8018, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_76 },
+  { .handle = 0x4e, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x02, .char_uuid = 0x8019 } },
+  { .handle = 0x4f, .uuid = 0x8019, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_78 },
+  { .handle = 0x50, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x801a } },
+  { .handle = 0x51, .uuid = 0x801a, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_80 },
+  { .handle = 0x52, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x801b } },
+  { .handle = 0x53, .uuid = 0x801b, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_82 },
+  { .handle = 0x54, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x801c } },
+  { .handle = 0x55, .uuid = 0x801c, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_84 },
+  { .handle = 0x56, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x801d } },
+  { .handle = 0x57, .uuid = 0x801d, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_86 },
+  { .handle = 0x58, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x801e } },
+  { .handle = 0x59, .uuid = 0x801e, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_88 },
+  { .handle = 0x5a, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x801f } },
+  { .handle = 0x5b, .uuid = 0x801f, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_90 },
+  { .handle = 0x5c, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x8020 } },
+  { .handle = 0x5d, .uuid = 0x8020, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_92 },
+  { .handle = 0x5e, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x8021 } },
+  { .handle = 0x5f, .uuid = 0x8021, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_94 },
+  { .handle = 0x60, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x8022 } },
+  { .handle = 0x61, .uuid = 0x8022, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x02, .dynamicdata = &gattdb_attribute_field_96 },
+  { .handle = 0x62, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x02, .char_uuid = 0x8023 } },
+  { .handle = 0x63, .uuid = 0x8023, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_98 },
+  { .handle = 0x64, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x8024 } },
+  { .handle = 0x65, .uuid = 0x8024, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_100 },
+  { .handle = 0x66, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x8025 } },
+  { .handle = 0x67, .uuid = 0x8025, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x02, .dynamicdata = &gattdb_attribute_field_102 },
+  { .handle = 0x68, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x8026 } },
+  { .handle = 0x69, .uuid = 0x8026, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_104 },
+  { .handle = 0x6a, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x8027 } },
+  { .handle = 0x6b, .uuid = 0x8027, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x02, .dynamicdata = &gattdb_attribute_field_106 },
+  { .handle = 0x6c, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x8028 } },
+  { .handle = 0x6d, .uuid = 0x8028, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_108 },
+  { .handle = 0x6e, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x8029 } },
+  { .handle = 0x6f, .uuid = 0x8029, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_110 },
+  { .handle = 0x70, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x802a } },
+  { .handle = 0x71, .uuid = 0x802a, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x02, .dynamicdata = &gattdb_attribute_field_112 },
+  { .handle = 0x72, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x802b } },
+  { .handle = 0x73, .uuid = 0x802b, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_114 },
+  { .handle = 0x74, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x802c } },
+  { .handle = 0x75, .uuid = 0x802c, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_116 },
+  { .handle = 0x76, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x802d } },
+  { .handle = 0x77, .uuid = 0x802d, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x02, .dynamicdata = &gattdb_attribute_field_118 },
+  { .handle = 0x78, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x802e } },
+  { .handle = 0x79, .uuid = 0x802e, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_120 },
+  { .handle = 0x7a, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x802f } },
+  { .handle = 0x7b, .uuid = 0x802f, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_122 },
+  { .handle = 0x7c, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x8030 } },
+  { .handle = 0x7d, .uuid = 0x8030, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_124 },
+  { .handle = 0x7e, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x0a, .char_uuid = 0x8031 } },
+  { .handle = 0x7f, .uuid = 0x8031, .permissions = 0x803, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_126 },
+  { .handle = 0x80, .uuid = 0x0002, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x05, .characteristic = { .properties = 0x02, .char_uuid = 0x8032 } },
+  { .handle = 0x81, .uuid = 0x8032, .permissions = 0x801, .caps = 0xffff, .state = 0x00, .datatype = 0x01, .dynamicdata = &gattdb_attribute_field_128 },
 };
 
 GATT_HEADER(const sli_bt_gattdb_t gattdb) = {
   .attributes = gattdb_attributes_map,
-  .attribute_table_size = 69,
-  .attribute_num = 69,
+  .attribute_table_size = 129,
+  .attribute_num = 129,
   .uuid16 = gattdb_uuidtable_16_map,
   .uuid16_table_size = 14,
   .uuid16_num = 14,
   .uuid128 = gattdb_uuidtable_128_map,
-  .uuid128_table_size = 21,
-  .uuid128_num = 21,
+  .uuid128_table_size = 51,
+  .uuid128_num = 51,
   .num_ccfg = 3,
   .caps_mask = 0xffff,
   .enabled_caps = 0xffff,
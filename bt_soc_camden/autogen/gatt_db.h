@@ -39,6 +39,36 @@ extern const sli_bt_gattdb_t gattdb;
 #define gattdb_LINEAR_SWEEP_SAMPLE_RATE       65
 #define gattdb_TIME_BEFORE_PULSE              67
 #define gattdb_TIME_AFTER_PULSE               69
+#define gattdb_ADC_TRANSFER_MODE              71
+#define gattdb_ADC_TRIGGER                    73
+#define gattdb_TRIGGER_JITTER                 75
+#define gattdb_ADC_PROFILE                    77
+#define gattdb_ADC_PLAN                       79
+#define gattdb_STREAM_MODE                    81
+#define gattdb_SAMPLE_WINDOW_COUNT            83
+#define gattdb_SAMPLE_WINDOW_DELAY            85
+#define gattdb_ELECTRODE_SCAN_MODE            87
+#define gattdb_ELECTRODE_MASK                 89
+#define gattdb_ELECTRODE_SETTLE               91
+#define gattdb_GAIN_AUTORANGE                 93
+#define gattdb_VDAC_PLAYBACK                  95
+#define gattdb_WAVEFORM_PROGRAM               97
+#define gattdb_WAVEFORM_STATUS                99
+#define gattdb_LINEAR_SWEEP_CYCLES            101
+#define gattdb_LINEAR_SWEEP_VERTICES          103
+#define gattdb_PULSE_PERIOD                   105
+#define gattdb_CHRONO_STEPS                   107
+#define gattdb_CHRONO_FAST_RATE               109
+#define gattdb_TIMEBASE                       111
+#define gattdb_EIS_FREQUENCIES                113
+#define gattdb_EIS_AMPLITUDE                  115
+#define gattdb_EIS_PERIODS                    117
+#define gattdb_PREPHASE_STEPS                 119
+#define gattdb_PREPHASE_RATE                  121
+#define gattdb_SAMPLE_LEAD                    123
+#define gattdb_VDAC_DRIVE                     125
+#define gattdb_CAPTURE_POLICY                 127
+#define gattdb_LINK_STATS                     129
 
 #define gattdb_generic_attribute_len          2
 #define gattdb_service_changed_char_len       4
@@ -70,6 +100,36 @@ extern const sli_bt_gattdb_t gattdb;
 #define gattdb_LINEAR_SWEEP_SAMPLE_RATE_len   2
 #define gattdb_TIME_BEFORE_PULSE_len          1
 #define gattdb_TIME_AFTER_PULSE_len           1
+#define gattdb_ADC_TRANSFER_MODE_len          1
+#define gattdb_ADC_TRIGGER_len                1
+#define gattdb_TRIGGER_JITTER_len             16
+#define gattdb_ADC_PROFILE_len                1
+#define gattdb_ADC_PLAN_len                   14
+#define gattdb_STREAM_MODE_len                1
+#define gattdb_SAMPLE_WINDOW_COUNT_len        2
+#define gattdb_SAMPLE_WINDOW_DELAY_len        4
+#define gattdb_ELECTRODE_SCAN_MODE_len        1
+#define gattdb_ELECTRODE_MASK_len             1
+#define gattdb_ELECTRODE_SETTLE_len           2
+#define gattdb_GAIN_AUTORANGE_len             1
+#define gattdb_VDAC_PLAYBACK_len              1
+#define gattdb_WAVEFORM_PROGRAM_len           240
+#define gattdb_WAVEFORM_STATUS_len            2
+#define gattdb_LINEAR_SWEEP_CYCLES_len        2
+#define gattdb_LINEAR_SWEEP_VERTICES_len      8
+#define gattdb_PULSE_PERIOD_len               2
+#define gattdb_CHRONO_STEPS_len               32
+#define gattdb_CHRONO_FAST_RATE_len           2
+#define gattdb_TIMEBASE_len                   1
+#define gattdb_EIS_FREQUENCIES_len            32
+#define gattdb_EIS_AMPLITUDE_len              2
+#define gattdb_EIS_PERIODS_len                1
+#define gattdb_PREPHASE_STEPS_len             16
+#define gattdb_PREPHASE_RATE_len              2
+#define gattdb_SAMPLE_LEAD_len                4
+#define gattdb_VDAC_DRIVE_len                 1
+#define gattdb_CAPTURE_POLICY_len             1
+#define gattdb_LINK_STATS_len                 12
 
 
 #endif // __GATT_DB_H
@@ -0,0 +1,163 @@
+/***************************************************************************//**
+ * @file
+ * @brief Single-producer single-consumer ring of BLE notification packets.
+ *******************************************************************************
+ *
+ * The producer (the acquisition interrupt) is the only writer of the head and
+ * the consumer (app_process_action) is the only writer of the tail. Both count
+ * freely and wrap at 2^32, so head - tail is the number of queued packets and
+ * the slot of index i is i & (capacity - 1).
+ *
+ * When the ring is full a producer that prefers new packets over old ones
+ * does not move the tail. It posts skip_to, the index the consumer has to
+ * resume from, and takes over the oldest slot, unless that slot is the one
+ * the consumer announced in reading.
+ *
+ * Only depends on the C library and a memory barrier, so test/ble_ring_test.c
+ * builds it on the host.
+ *
+ ******************************************************************************/
+
+#ifndef BLE_RING_H
+#define BLE_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __arm__
+#include "em_device.h"
+#define BLE_RING_BARRIER()  __DMB()
+#else
+#define BLE_RING_BARRIER()  __sync_synchronize()
+#endif
+
+// Where the producer may preempt the consumer inside ble_ring_peek, the host test runs it there
+#ifndef BLE_RING_CONSUMER_YIELD
+#define BLE_RING_CONSUMER_YIELD()
+#endif
+
+#define BLE_MAX_PACKET_SIZE 244  // Maximum size of each packet, one 251 octet link-layer PDU
+
+typedef struct {
+    uint8_t data[BLE_MAX_PACKET_SIZE];
+    uint8_t size;  // Actual packet size
+} ble_packet_t;
+
+typedef struct {
+    ble_packet_t     *slots;
+    uint32_t          capacity;  // Power of two
+    volatile uint32_t head;      // Next position to write, reserved for the packet being built
+    volatile uint32_t tail;      // Next position to read
+    volatile uint32_t skip_to;   // Producer: packets before this index were overwritten
+    volatile uint32_t reading;   // Consumer: index of the packet it may be reading
+} ble_ring_t;
+
+// Point the ring at capacity slots and empty it, only while neither side is using it
+static inline void ble_ring_init(ble_ring_t *ring, ble_packet_t *slots, uint32_t capacity)
+{
+    ring->slots    = slots;
+    ring->capacity = capacity;
+    ring->head     = 0;
+    ring->tail     = 0;
+    ring->skip_to  = 0;
+    ring->reading  = (uint32_t)-1;  // Behind the tail, so nothing is in use
+}
+
+static inline uint32_t ble_ring_count(const ble_ring_t *ring)
+{
+    return (uint32_t)(ring->head - ring->tail);
+}
+
+static inline bool ble_ring_is_full(const ble_ring_t *ring)
+{
+    return ble_ring_count(ring) >= ring->capacity;
+}
+
+static inline bool ble_ring_is_empty(const ble_ring_t *ring)
+{
+    return ring->head == ring->tail;
+}
+
+// Producer: the slot after the queued packets to pack the next one into, NULL while the ring is full
+static inline uint8_t *ble_ring_reserve(ble_ring_t *ring)
+{
+    if (ble_ring_is_full(ring)) {
+        return NULL;
+    }
+    return ring->slots[ring->head & (ring->capacity - 1)].data;
+}
+
+// Producer: as ble_ring_reserve, but when the ring is full the oldest packet is given up for the new one
+// and *overwrote is set. NULL only while the consumer is reading that packet.
+static inline uint8_t *ble_ring_reserve_overwrite(ble_ring_t *ring, bool *overwrote)
+{
+    uint32_t reused = ring->head - ring->capacity;  // Packet whose slot the new one goes into
+    *overwrote = false;
+    if ((int32_t)(ring->tail - reused) <= 0) {
+        // The consumer has not released that slot yet
+        if (ring->reading == reused) {
+            return NULL;
+        }
+        if ((int32_t)(ring->skip_to - reused) <= 0) {
+            ring->skip_to = reused + 1;
+            *overwrote = true;
+        }
+        // The consumer has to see the skip before it could read the slot being rewritten
+        BLE_RING_BARRIER();
+    }
+    return ring->slots[ring->head & (ring->capacity - 1)].data;
+}
+
+// Producer: queue the reserved slot holding size bytes
+static inline void ble_ring_commit(ble_ring_t *ring, uint8_t size)
+{
+    ring->slots[ring->head & (ring->capacity - 1)].size = size;
+
+    // Publish the head only after the packet contents are visible to the consumer
+    BLE_RING_BARRIER();
+    ring->head = ring->head + 1;
+}
+
+// Consumer: the oldest packet, left in place until it is popped or released so a refused send can be
+// retried. Overwritten packets are skipped first.
+static inline ble_packet_t *ble_ring_peek(ble_ring_t *ring)
+{
+    for (;;) {
+        uint32_t tail    = ring->tail;
+        uint32_t skip_to = ring->skip_to;
+        if ((int32_t)(skip_to - tail) > 0) {
+            tail       = skip_to;
+            ring->tail = tail;
+        }
+        BLE_RING_CONSUMER_YIELD();
+        if (ring->head == tail) {
+            return NULL;
+        }
+        // Announce the packet, then make sure the producer did not take its slot over just before
+        ring->reading = tail;
+        BLE_RING_BARRIER();
+        BLE_RING_CONSUMER_YIELD();
+        if (ring->skip_to == skip_to) {
+            // Read the packet contents only after seeing the head that published them
+            return &ring->slots[tail & (ring->capacity - 1)];
+        }
+    }
+}
+
+// Consumer: stop reading the oldest packet without sending it, it stays queued
+static inline void ble_ring_release(ble_ring_t *ring)
+{
+    BLE_RING_BARRIER();
+    ring->reading = ring->tail - 1;
+}
+
+// Consumer: release the oldest packet's slot to the producer
+static inline void ble_ring_pop(ble_ring_t *ring)
+{
+    // Hand the slot back only after the stack is done reading it
+    BLE_RING_BARRIER();
+    ring->tail = ring->tail + 1;
+}
+
+#endif // BLE_RING_H
@@ -0,0 +1,185 @@
+/***************************************************************************//**
+ * @file
+ * @brief Host stress test of the BLE packet ring in bt_soc_camden/ble_ring.h.
+ *******************************************************************************
+ *
+ * Build and run from the repository root:
+ *   cc -O2 -Wall -Ibt_soc_camden -o ble_ring_test test/ble_ring_test.c && ./ble_ring_test
+ *
+ * A producer and a consumer are stepped at random interleavings, a few bytes
+ * at a time, so either side can be caught halfway through a packet. The
+ * producer also runs inside ble_ring_peek, where the acquisition interrupt can
+ * preempt the main loop. Every packet carries its sequence number and a
+ * pattern derived from it. The consumer checks that packets arrive whole, in
+ * order, and that the only missing ones are those the producer counted as
+ * dropped or, when it overwrites the oldest packet, as overwritten.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void producerYield(void);
+#define BLE_RING_CONSUMER_YIELD() producerYield()
+
+#include "ble_ring.h"
+
+#define MAX_CAPACITY   16
+#define PACKETS        20000
+#define SEEDS          400
+#define CHUNK          61  // Bytes moved per step
+
+static ble_packet_t slots[MAX_CAPACITY];
+static uint8_t      discard[BLE_MAX_PACKET_SIZE];
+static bool         lost[PACKETS];      // Dropped or overwritten by the producer
+static uint32_t     seq_at[PACKETS];    // Packet committed at each ring index
+
+static ble_ring_t ring;
+static bool       overwrite;
+static int        producer_weight;      // Out of 10, from mostly empty to mostly full
+
+// Producer
+static uint32_t produced;
+static uint8_t *packing;
+static uint32_t packed;
+static uint32_t lost_count;
+
+static uint8_t packetSize(uint32_t seq)
+{
+  return (uint8_t)(4 + seq % (BLE_MAX_PACKET_SIZE - 3));
+}
+
+static uint8_t packetByte(uint32_t seq, uint32_t i)
+{
+  if (i < 4) {
+    return (uint8_t)(seq >> (8 * i));
+  }
+  return (uint8_t)(seq * 31 + i);
+}
+
+static void producerStep(void)
+{
+  if (packing == NULL) {
+    if (overwrite) {
+      bool overwrote;
+      packing = ble_ring_reserve_overwrite(&ring, &overwrote);
+      if (overwrote) {
+        lost[seq_at[ring.head - ring.capacity]] = true;
+        lost_count++;
+      }
+    } else {
+      packing = ble_ring_reserve(&ring);
+    }
+    if (packing == NULL) {
+      packing = discard;
+    }
+    packed = 0;
+  } else if (packed < packetSize(produced)) {
+    for (uint32_t n = 0; n < CHUNK && packed < packetSize(produced); n++, packed++) {
+      packing[packed] = packetByte(produced, packed);
+    }
+  } else {
+    if (packing == discard) {
+      lost[produced] = true;
+      lost_count++;
+    } else {
+      seq_at[ring.head] = produced;
+      ble_ring_commit(&ring, packetSize(produced));
+    }
+    packing = NULL;
+    produced++;
+  }
+}
+
+static void producerYield(void)
+{
+  while (produced < PACKETS && rand() % 10 < producer_weight) {
+    producerStep();
+  }
+}
+
+static int fail(unsigned seed, const char *what, uint32_t seq)
+{
+  printf("FAIL seed %u (%s, capacity %lu): %s at packet %lu\n", seed, overwrite ? "overwrite" : "drop new",
+         (unsigned long)ring.capacity, what, (unsigned long)seq);
+  return 1;
+}
+
+static int runSeed(unsigned seed)
+{
+  srand(seed);
+  ble_ring_init(&ring, slots, 1u << (rand() % 5));
+  overwrite = rand() % 2;
+  producer_weight = 1 + rand() % 9;
+  memset(lost, 0, sizeof(lost));
+  produced = 0;
+  packing = NULL;
+  lost_count = 0;
+
+  // Consumer
+  uint32_t expected = 0;
+  uint32_t received = 0;
+  ble_packet_t *reading = NULL;
+  uint8_t copy[BLE_MAX_PACKET_SIZE];
+  uint32_t copied = 0;
+
+  while (produced < PACKETS || !ble_ring_is_empty(&ring) || reading != NULL) {
+    if (produced < PACKETS && rand() % 10 < producer_weight) {
+      producerStep();
+      continue;
+    }
+
+    if (reading == NULL) {
+      reading = ble_ring_peek(&ring);
+      copied = 0;
+    } else if (copied < reading->size) {
+      for (uint32_t n = 0; n < CHUNK && copied < reading->size; n++, copied++) {
+        copy[copied] = reading->data[copied];
+      }
+    } else {
+      uint32_t seq = copy[0] | (copy[1] << 8) | (copy[2] << 16) | ((uint32_t)copy[3] << 24);
+      if (seq >= PACKETS || lost[seq]) {
+        return fail(seed, "lost packet received", seq);
+      }
+      while (expected < seq && lost[expected]) {
+        expected++;
+      }
+      if (seq != expected) {
+        return fail(seed, "out of order or missing", expected);
+      }
+      if (reading->size != packetSize(seq)) {
+        return fail(seed, "wrong size", seq);
+      }
+      for (uint32_t i = 0; i < reading->size; i++) {
+        if (copy[i] != packetByte(seq, i)) {
+          return fail(seed, "torn packet", seq);
+        }
+      }
+      // Now and then the send is refused and the packet is read again, unless it gets overwritten
+      if (rand() % 8 != 0) {
+        ble_ring_pop(&ring);
+        expected++;
+        received++;
+      } else {
+        ble_ring_release(&ring);
+      }
+      reading = NULL;
+    }
+  }
+
+  if (received + lost_count != PACKETS) {
+    return fail(seed, "count mismatch", received);
+  }
+  return 0;
+}
+
+int main(void)
+{
+  int failures = 0;
+  for (unsigned seed = 1; seed <= SEEDS; seed++) {
+    failures += runSeed(seed);
+  }
+  printf("%s: %d of %d seeds failed\n", failures ? "FAIL" : "PASS", failures, SEEDS);
+  return failures ? 1 : 0;
+}